@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#define BFUTILS_PROCESS_IMPLEMENTATION
+#include "bfutils_process.h"
+
+// Measures how many processes per second can be started from a parent with a large heap.
+// Usage: bench [heap size in MB] [number of spawns]
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_fork(int spawns) {
+    double start = now();
+    for (int i = 0; i < spawns; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execlp("true", "true", NULL);
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    printf("fork + exec:   %10.1f spawns/s\n", spawns / (now() - start));
+}
+
+static void bench_process_async(int spawns) {
+    double start = now();
+    for (int i = 0; i < spawns; i++) {
+        Process p = process_async((char*[]){"true", NULL});
+        process_wait(&p);
+        process_close(&p);
+    }
+    printf("process_async: %10.1f spawns/s\n", spawns / (now() - start));
+}
+
+int main(int argc, char *argv[]) {
+    size_t heap_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+    int spawns = argc > 2 ? atoi(argv[2]) : 1000;
+
+    // The heap is touched, so its pages are actually mapped in the parent.
+    char *heap = malloc(heap_mb << 20);
+    if (heap == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memset(heap, 1, heap_mb << 20);
+    printf("heap: %zu MB, spawns: %d\n", heap_mb, spawns);
+
+    bench_fork(spawns);
+    bench_process_async(spawns);
+
+    free(heap);
+    return 0;
+}
@@ -105,6 +105,8 @@ void write_file(const char *name, const char *content) {
 #define HEADERS \
     X(HASHMAP, "bfutils_hash.h", 'm', "hashmap") \
     X(VECTOR, "bfutils_vector.h", 'v', "vector") \
+    X(DEQUE, "bfutils_deque.h", 'd', "deque") \
+    X(BITSET, "bfutils_bitset.h", 's', "bitset") \
     X(PROCESS, "bfutils_process.h", 'p', "process") \
     X(TEST, "bfutils_test.h", 't', "test") \
     X(BUILD, "bfutils_build.h", 'b', "build")
@@ -0,0 +1,309 @@
+/* bfutils_bitset.h
+
+DESCRIPTION:
+
+    This is a single-header-file library that provides growable bitsets for C.
+    Bits are stored in 64 bit words, so searching, counting and set operations work on a whole word at a time.
+    The set operations (and, or, xor, andnot) process 4 words per iteration using the compiler vector extensions,
+    which are compiled to SSE/AVX/NEON instructions when they are available.
+
+USAGE:
+
+    In one source file put:
+        #define BFUTILS_BITSET_IMPLEMENTATION
+        #include "bfutils_bitset.h"
+
+    Other source files should contain only the import line.
+
+    A bitset is declared as: uint64_t *bitset = NULL;
+
+    Functions (macros):
+
+        bitset_header:
+            BFUtilsBitsetHeader *bitset_header(uint64_t*); Returns the header object.
+
+        bitset_length:
+            size_t bitset_length(uint64_t*); Returns the number of bits of the bitset.
+
+        bitset_words:
+            size_t bitset_words(uint64_t*); Returns the number of 64 bit words used by the bitset.
+
+        bitset_resize:
+            void bitset_resize(uint64_t*, size_t); Changes the number of bits of the bitset. New bits are cleared.
+
+        bitset_set:
+            void bitset_set(uint64_t*, size_t); Sets the bit at the provided index. The index must be less than bitset_length.
+
+        bitset_clear:
+            void bitset_clear(uint64_t*, size_t); Clears the bit at the provided index. The index must be less than bitset_length.
+
+        bitset_test:
+            int bitset_test(uint64_t*, size_t); Returns a non-zero value if the bit at the provided index is set.
+
+        bitset_clear_all:
+            void bitset_clear_all(uint64_t*); Clears all bits.
+
+        bitset_count:
+            size_t bitset_count(uint64_t*); Returns the number of set bits.
+
+        bitset_rank:
+            size_t bitset_rank(uint64_t*, size_t); Returns the number of set bits before the provided index.
+
+        bitset_next_set:
+            long bitset_next_set(uint64_t*, size_t); Returns the index of the first set bit at or after the provided index, or -1 if there is none.
+
+        bitset_next_clear:
+            long bitset_next_clear(uint64_t*, size_t); Returns the index of the first cleared bit at or after the provided index, or -1 if there is none.
+
+        bitset_and:
+        bitset_or:
+        bitset_xor:
+        bitset_andnot:
+            void bitset_and(uint64_t *dst, uint64_t *src); Stores in dst the result of dst & src (dst | src, dst ^ src, dst & ~src).
+            Only the first min(bitset_length(dst), bitset_length(src)) bits of dst are changed.
+
+        bitset_free:
+            void bitset_free(uint64_t*); Frees the bitset.
+
+    Compile-time options:
+
+        #define BFUTILS_BITSET_NO_SHORT_NAME
+
+            This flag needs to be set globally.
+            By default this file exposes functions without bfutils_ prefix.
+            By defining this flag, this library will expose only functions prefixed with bfutils_
+
+        #define BFUTILS_BITSET_REALLOC another_realloc
+        #define BFUTILS_BITSET_FREE another_free
+
+            These flags needs to be set only in the file containing #define BFUTILS_BITSET_IMPLEMENTATION
+            If you don't want to use 'stdlib.h' realloc and free function you can define this flag with a custom function.
+
+LICENSE:
+
+    MIT License
+
+    Copyright (c) 2024 Bruno Flávio Ferreira
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef BFUTILS_BITSET_H
+#define BFUTILS_BITSET_H
+
+#ifndef BFUTILS_BITSET_NO_SHORT_NAME
+
+#define bitset_header bfutils_bitset_header
+#define bitset_length bfutils_bitset_length
+#define bitset_words bfutils_bitset_words
+#define bitset_resize bfutils_bitset_resize
+#define bitset_set bfutils_bitset_set
+#define bitset_clear bfutils_bitset_clear
+#define bitset_test bfutils_bitset_test
+#define bitset_clear_all bfutils_bitset_clear_all
+#define bitset_count bfutils_bitset_count
+#define bitset_rank bfutils_bitset_rank
+#define bitset_next_set bfutils_bitset_next_set
+#define bitset_next_clear bfutils_bitset_next_clear
+#define bitset_and bfutils_bitset_and
+#define bitset_or bfutils_bitset_or
+#define bitset_xor bfutils_bitset_xor
+#define bitset_andnot bfutils_bitset_andnot
+#define bitset_free bfutils_bitset_free
+
+#endif //BFUTILS_BITSET_NO_SHORT_NAME
+
+#if (!defined(BFUTILS_BITSET_REALLOC) && defined(BFUTILS_BITSET_FREE)) || (defined(BFUTILS_BITSET_REALLOC) && !defined(BFUTILS_BITSET_FREE))
+#error "You must define both BFUTILS_BITSET_REALLOC and BFUTILS_BITSET_FREE or neither."
+#endif
+
+#ifndef BFUTILS_BITSET_REALLOC
+#include <stdlib.h>
+#define BFUTILS_BITSET_REALLOC realloc
+#define BFUTILS_BITSET_FREE free
+#endif //BFUTILS_BITSET_REALLOC
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    size_t length;
+    size_t capacity;
+} BFUtilsBitsetHeader;
+
+enum BFUtilsBitsetOperation {
+    BFUTILS_BITSET_AND,
+    BFUTILS_BITSET_OR,
+    BFUTILS_BITSET_XOR,
+    BFUTILS_BITSET_ANDNOT,
+};
+
+#define bfutils_bitset_header(b) ((b) ? (BFUtilsBitsetHeader *) (b) - 1 : NULL)
+#define bfutils_bitset_length(b) ((b) ? bfutils_bitset_header((b))->length : 0)
+#define bfutils_bitset_words(b) ((bfutils_bitset_length((b)) + 63) / 64)
+#define bfutils_bitset_resize(b, l) ((b) = bfutils_bitset_resize_f((b), (l)))
+#define bfutils_bitset_set(b, i) ((b)[(i) / 64] |= (UINT64_C(1) << ((i) % 64)))
+#define bfutils_bitset_clear(b, i) ((b)[(i) / 64] &= ~(UINT64_C(1) << ((i) % 64)))
+#define bfutils_bitset_test(b, i) (((b)[(i) / 64] >> ((i) % 64)) & 1)
+#define bfutils_bitset_and(d, s) (bfutils_bitset_operation((d), (s), BFUTILS_BITSET_AND))
+#define bfutils_bitset_or(d, s) (bfutils_bitset_operation((d), (s), BFUTILS_BITSET_OR))
+#define bfutils_bitset_xor(d, s) (bfutils_bitset_operation((d), (s), BFUTILS_BITSET_XOR))
+#define bfutils_bitset_andnot(d, s) (bfutils_bitset_operation((d), (s), BFUTILS_BITSET_ANDNOT))
+#define bfutils_bitset_free(b) (bfutils_bitset_free_f((b)), (b) = NULL)
+
+extern uint64_t *bfutils_bitset_resize_f(uint64_t *bitset, size_t length);
+extern void bfutils_bitset_clear_all(uint64_t *bitset);
+extern size_t bfutils_bitset_count(const uint64_t *bitset);
+extern size_t bfutils_bitset_rank(const uint64_t *bitset, size_t index);
+extern long bfutils_bitset_next_set(const uint64_t *bitset, size_t index);
+extern long bfutils_bitset_next_clear(const uint64_t *bitset, size_t index);
+extern void bfutils_bitset_operation(uint64_t *dst, const uint64_t *src, enum BFUtilsBitsetOperation op);
+extern void bfutils_bitset_free_f(uint64_t *bitset);
+
+#endif // BFUTILS_BITSET_H
+#ifdef BFUTILS_BITSET_IMPLEMENTATION
+#include <string.h>
+
+typedef uint64_t BFUtilsBitsetBlock __attribute__((vector_size(32)));
+
+// Bits after length in the last word are always kept cleared, so whole words can be counted and searched.
+static uint64_t bfutils_bitset_last_word_mask(size_t length) {
+    return length % 64 == 0 ? ~UINT64_C(0) : (UINT64_C(1) << (length % 64)) - 1;
+}
+
+uint64_t *bfutils_bitset_resize_f(uint64_t *bitset, size_t length) {
+    size_t old_words = bfutils_bitset_words(bitset);
+    size_t words = (length + 63) / 64;
+    if (bitset == NULL || bfutils_bitset_header(bitset)->capacity < words) {
+        size_t capacity = bitset ? bfutils_bitset_header(bitset)->capacity * 2 : 0;
+        if (capacity < words) {
+            capacity = words;
+        }
+        BFUtilsBitsetHeader *header = BFUTILS_BITSET_REALLOC(bfutils_bitset_header(bitset), sizeof(BFUtilsBitsetHeader) + (sizeof(uint64_t) * capacity));
+        header->capacity = capacity;
+        bitset = (uint64_t*)(header + 1);
+    }
+    if (words > old_words) {
+        memset(bitset + old_words, 0, sizeof(uint64_t) * (words - old_words));
+    }
+    bfutils_bitset_header(bitset)->length = length;
+    if (words > 0) {
+        bitset[words - 1] &= bfutils_bitset_last_word_mask(length);
+    }
+    return bitset;
+}
+
+void bfutils_bitset_clear_all(uint64_t *bitset) {
+    if (bitset == NULL) return;
+    memset(bitset, 0, sizeof(uint64_t) * bfutils_bitset_words(bitset));
+}
+
+size_t bfutils_bitset_count(const uint64_t *bitset) {
+    size_t count = 0;
+    size_t words = bfutils_bitset_words(bitset);
+    for (size_t i = 0; i < words; i++) {
+        count += __builtin_popcountll(bitset[i]);
+    }
+    return count;
+}
+
+size_t bfutils_bitset_rank(const uint64_t *bitset, size_t index) {
+    if (index > bfutils_bitset_length(bitset)) {
+        index = bfutils_bitset_length(bitset);
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < index / 64; i++) {
+        count += __builtin_popcountll(bitset[i]);
+    }
+    if (index % 64 != 0) {
+        count += __builtin_popcountll(bitset[index / 64] & ((UINT64_C(1) << (index % 64)) - 1));
+    }
+    return count;
+}
+
+long bfutils_bitset_next_set(const uint64_t *bitset, size_t index) {
+    if (index >= bfutils_bitset_length(bitset)) return -1;
+    size_t words = bfutils_bitset_words(bitset);
+    size_t i = index / 64;
+    uint64_t word = bitset[i] & (~UINT64_C(0) << (index % 64));
+    while (word == 0) {
+        if (++i == words) return -1;
+        word = bitset[i];
+    }
+    return i * 64 + __builtin_ctzll(word);
+}
+
+long bfutils_bitset_next_clear(const uint64_t *bitset, size_t index) {
+    size_t length = bfutils_bitset_length(bitset);
+    if (index >= length) return -1;
+    size_t words = bfutils_bitset_words(bitset);
+    size_t i = index / 64;
+    uint64_t word = ~bitset[i] & (~UINT64_C(0) << (index % 64));
+    while (word == 0) {
+        if (++i == words) return -1;
+        word = ~bitset[i];
+    }
+    size_t pos = i * 64 + __builtin_ctzll(word);
+    return pos < length ? (long) pos : -1;
+}
+
+void bfutils_bitset_operation(uint64_t *dst, const uint64_t *src, enum BFUtilsBitsetOperation op) {
+    size_t length = bfutils_bitset_length(dst) < bfutils_bitset_length(src) ? bfutils_bitset_length(dst) : bfutils_bitset_length(src);
+    size_t words = length / 64;
+    size_t blocks = words / 4;
+    for (size_t i = 0; i < blocks; i++) {
+        BFUtilsBitsetBlock a, b;
+        memcpy(&a, dst + (i * 4), sizeof(a));
+        memcpy(&b, src + (i * 4), sizeof(b));
+        switch (op) {
+            case BFUTILS_BITSET_AND: a &= b; break;
+            case BFUTILS_BITSET_OR: a |= b; break;
+            case BFUTILS_BITSET_XOR: a ^= b; break;
+            case BFUTILS_BITSET_ANDNOT: a &= ~b; break;
+        }
+        memcpy(dst + (i * 4), &a, sizeof(a));
+    }
+    for (size_t i = blocks * 4; i < words; i++) {
+        switch (op) {
+            case BFUTILS_BITSET_AND: dst[i] &= src[i]; break;
+            case BFUTILS_BITSET_OR: dst[i] |= src[i]; break;
+            case BFUTILS_BITSET_XOR: dst[i] ^= src[i]; break;
+            case BFUTILS_BITSET_ANDNOT: dst[i] &= ~src[i]; break;
+        }
+    }
+    if (length % 64 != 0) {
+        // Only the bits before length can be changed on the last word.
+        uint64_t mask = bfutils_bitset_last_word_mask(length);
+        uint64_t value = dst[words];
+        switch (op) {
+            case BFUTILS_BITSET_AND: value &= src[words]; break;
+            case BFUTILS_BITSET_OR: value |= src[words]; break;
+            case BFUTILS_BITSET_XOR: value ^= src[words]; break;
+            case BFUTILS_BITSET_ANDNOT: value &= ~src[words]; break;
+        }
+        dst[words] = (dst[words] & ~mask) | (value & mask);
+    }
+}
+
+void bfutils_bitset_free_f(uint64_t *bitset) {
+    if (bitset == NULL) return;
+    BFUTILS_BITSET_FREE(bfutils_bitset_header(bitset));
+}
+#endif //BFUTILS_BITSET_IMPLEMENTATION
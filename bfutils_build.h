@@ -8,6 +8,9 @@ DEPENDENCIES:
     
     - ninja (https://ninja-build.org/)
     - pkg-config (optional)
+        The results of pkg-config are cached on target/pkg-config.cache, and each dep is resolved again only when its .pc file changes.
+    - ccache or sccache (optional)
+        If one of them is found on PATH, it's used to cache the compilation of the ".o" files.
 
 USAGE:
     
@@ -25,6 +28,8 @@ USAGE:
 
     Then you just need to execute "./build". 
     "build.c" needs to be compiled only once, as it can rebuild itself before building your project.
+    A compile_commands.json with the compilation commands of your project is also generated on the build directory (target, or target/${profile}).
+    The one of the default profile (the first one) is copied to the project root directory, so the tools always see the same flags.
     
     Functions (macros):
         
@@ -32,7 +37,8 @@ USAGE:
             void bfutils_add_executable(BFUtilsBuildCfg cfg); This function needs to be called inside bfutils_build.
             It defines an new compilation target for your project.
             It will compile an executable on target/bin with the name defined in "cfg.name".
-            Each file in "cfg.files" will be compiled to a ".o" file on target/objs.
+            Each file in "cfg.files" will be compiled to a ".o" file on target/objs, on the same directory structure of the source file.
+            The same file can be used by many targets, and it is compiled only once for all the targets that use the same cflags.
             If BFUTILS_BUILD_CFLAGS is defined it will be included on the compilation command for the ".o" files.
             If "cfg.cflags" is not NULL, it will be used instead of BFUTILS_BUILD_CFLAGS.
             If BFUTILS_BUILD_LDFLAGS is defined, it will be included on the link command for the executable file.
@@ -48,6 +54,27 @@ USAGE:
             If BFUTILS_BUILD_LDFLAGS is defined, it will be included on the link command for the shared library.
             If "cfg.ldflags" is not NULL, it will be used instead of BFUTILS_BUILD_LDFLAGS.
 
+        bfutils_add_static_library:
+            void bfutils_add_static_library(BFUtilsBuildCfg); This function needs to be called inside bfutils_build.
+            It defines an new compilation target for your project.
+            It will archive a static library on target/lib with the name "lib${cfg.name}.a".
+            Each file in "cfg.files" will be compiled to a ".o" file on target/objs, with "-fPIC" so it can also be linked to a shared library.
+            If BFUTILS_BUILD_CFLAGS is defined it will be included on the compilation command for the ".o" files.
+            If "cfg.cflags" is not NULL, it will be used instead of BFUTILS_BUILD_CFLAGS.
+            The ldflags of its "cfg.deps", "cfg.libs" and "cfg.ldflags" are used when linking the targets that depend on it.
+
+        All the functions above also accept the following options:
+            "cfg.libs" is a list of libraries, defined before this target, that will be linked to it.
+            If "cfg.lto" is not zero, the target will be compiled and linked with "-flto=auto".
+            If "cfg.unity" is greater than zero, every "cfg.unity" source files are compiled together as one translation unit on target/unity/${cfg.name}.
+            The name of each target, with any character other than letters, digits and '-' replaced by '_', must be unique.
+
+        bfutils_add_executable also accepts "cfg.pgo_train", a shell command used to train a profile-guided optimization build.
+            An instrumented executable is built on target/pgo/${cfg.name}/bin/${cfg.name} and "cfg.pgo_train" is executed to generate its profile.
+            The path of the instrumented executable is exported to "cfg.pgo_train" as $BFUTILS_BUILD_PGO_BIN.
+            The objects of target/bin/${cfg.name} are then compiled with the profile, and ninja rebuilds them whenever the instrumented executable changes.
+            Both gcc (-fprofile-use) and clang (llvm-profdata) are supported.
+
     Compile-time options:
         
         #define BFUTILS_BUILD_CFLAGS cflags
@@ -56,6 +83,20 @@ USAGE:
         These flags needs to be defined before the #include "bfutils_build.h".
         These flags sets the default CFLAGS and LDFLAGS used for compiling and linking your project.
 
+        #define BFUTILS_BUILD_PROFILES \
+            X("debug", "-g -O0", "") \
+            X("release", "-O3 -DNDEBUG", "-s")
+
+        BFUTILS_BUILD_PROFILES defines the build profiles, each one with its own cflags and ldflags.
+        These flags are used in addition to the flags of each target.
+        The profile is selected by the first argument, as in "./build release", and the first profile is used if no profile is given.
+        If the first argument is not the name of a profile, the valid names are printed and the build fails.
+        Each profile is built on its own directory, target/${profile}, so changing between profiles doesn't rebuild the others.
+
+        #define BFUTILS_BUILD_NO_COMPILER_CACHE
+
+        If BFUTILS_BUILD_NO_COMPILER_CACHE is defined, ccache and sccache are not used even if they are found on PATH.
+
 LICENSE:
 
     MIT License
@@ -100,6 +141,11 @@ typedef struct {
     int deps_len;
     char *cflags;
     char *ldflags;
+    char **libs;
+    int libs_len;
+    int lto;
+    int unity;
+    char *pgo_train;
 }BFUtilsBuildCfg;
 
 enum BFUtilsBuildError {
@@ -111,60 +157,135 @@ enum BFUtilsBuildError {
     BFUTILS_BUILD_ERROR_MISSING_FILE,
     BFUTILS_BUILD_ERROR_INVALID_FILENAME,
     BFUTILS_BUILD_ERROR_PKG_CONFIG,
+    BFUTILS_BUILD_ERROR_MISSING_LIBRARY,
+    BFUTILS_BUILD_ERROR_OBJECT_CONFLICT,
+    BFUTILS_BUILD_ERROR_UNKNOWN_PROFILE,
+    BFUTILS_BUILD_ERROR_DUPLICATE_NAME,
 };
 
 #define bfutils_add_executable(...) bfutils_add_executable_fn((BFUtilsBuildCfg){__VA_ARGS__}, __FILE__, __LINE__);
 #define bfutils_add_shared_library(...) bfutils_add_shared_library_fn((BFUtilsBuildCfg){__VA_ARGS__}, __FILE__, __LINE__);
+#define bfutils_add_static_library(...) bfutils_add_static_library_fn((BFUtilsBuildCfg){__VA_ARGS__}, __FILE__, __LINE__);
 void bfutils_build(int argc, char *argv[]);
 void bfutils_add_executable_fn(BFUtilsBuildCfg cfg, char *file, int line);
 void bfutils_add_shared_library_fn(BFUtilsBuildCfg cfg, char *file, int line);
+void bfutils_add_static_library_fn(BFUtilsBuildCfg cfg, char *file, int line);
 
 #endif //BFUTILS_BUILD_H
 #ifdef BFUTILS_BUILD_IMPLEMENTATION
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
-#include <libgen.h>
 #include <unistd.h>
 
 extern char **environ;
 static FILE *bfutils_build_fp = NULL;
-static char* bfutils_build_source_files[255];
-static int bfutils_build_source_files_len = 0;
+static FILE *bfutils_build_compdb_fp = NULL;
+static int bfutils_build_compdb_len = 0;
+static char bfutils_build_cc[255] = "gcc";
+static int bfutils_build_clang = 0;
+// The output directory of the selected profile, "target" if BFUTILS_BUILD_PROFILES is not defined.
+static char *bfutils_build_dir = "target";
+static void bfutils_build_update_file(char *tmp, char *path);
+static void bfutils_build_copy_file(char *src, char *tmp, char *path);
+static char *bfutils_build_format(char *format, ...);
+
+typedef struct {
+    char *name;
+    char *cflags;
+    char *ldflags;
+} BFUtilsBuildProfile;
+
+#ifdef BFUTILS_BUILD_PROFILES
+#define X(name, cflags, ldflags) {name, cflags, ldflags},
+static BFUtilsBuildProfile bfutils_build_profiles[] = { BFUTILS_BUILD_PROFILES };
+#undef X
+#else
+static BFUtilsBuildProfile bfutils_build_profiles[] = { {"", "", ""} };
+#endif //BFUTILS_BUILD_PROFILES
+static BFUtilsBuildProfile bfutils_build_profile;
+
+static void bfutils_build_mkdir(char *path) {
+    if (mkdir(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create %s directory: %s\n", path, strerror(errno));
+        exit(BFUTILS_BUILD_ERROR_MKDIR);
+    }
+}
+
+// Returns the first compiler cache (ccache or sccache) found on PATH, or NULL if there is none.
+static char *bfutils_build_find_compiler_cache() {
+    #ifndef BFUTILS_BUILD_NO_COMPILER_CACHE
+    char *names[] = {"ccache", "sccache"};
+    char *path = getenv("PATH");
+    if (path == NULL || strstr(bfutils_build_cc, "ccache") != NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        for (char *dir = path; *dir; dir += strcspn(dir, ":") + (dir[strcspn(dir, ":")] == ':')) {
+            char *file = bfutils_build_format("%.*s/%s", (int) strcspn(dir, ":"), dir, names[i]);
+            int found = access(file, X_OK) == 0;
+            free(file);
+            if (found) {
+                return names[i];
+            }
+        }
+    }
+    #endif //BFUTILS_BUILD_NO_COMPILER_CACHE
+    return NULL;
+}
+
 int main(int argc, char *argv[]) {
-    char cc[255] = "gcc";
+    char *cc = bfutils_build_cc;
+    char ar[255] = "ar";
     char **env = environ;
     while (*env) {
         if (strncmp(*env, "CC=", 3) == 0) {
             strncpy(cc, (*env) + 3, 254);
-            break;
+        }
+        else if (strncmp(*env, "AR=", 3) == 0) {
+            strncpy(ar, (*env) + 3, 254);
         }
         env++;
     }
 
-    if (mkdir("target", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0 && errno != EEXIST) {
-        perror("Failed to create target directory");
-        exit(BFUTILS_BUILD_ERROR_MKDIR);
-    }
-    if (mkdir("target/bin", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0 && errno != EEXIST) {
-        perror("Failed to create target/bin directory");
-        exit(BFUTILS_BUILD_ERROR_MKDIR);
-    }
-    if (mkdir("target/objs", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0 && errno != EEXIST) {
-        perror("Failed to create target/objs directory");
-        exit(BFUTILS_BUILD_ERROR_MKDIR);
-    }
-    bfutils_build_fp = fopen("target/build.ninja", "w");
-    if (bfutils_build_fp == NULL) {
-        perror("Failed to open target/build.ninja");
-        exit(BFUTILS_BUILD_ERROR_OPEN);
+    BFUtilsBuildProfile profile = bfutils_build_profiles[0];
+    #ifdef BFUTILS_BUILD_PROFILES
+    size_t profiles_len = sizeof(bfutils_build_profiles) / sizeof(bfutils_build_profiles[0]);
+    if (argc > 1) {
+        size_t i = 0;
+        while (i < profiles_len && strcmp(argv[1], bfutils_build_profiles[i].name) != 0) {
+            i++;
+        }
+        if (i == profiles_len) {
+            fprintf(stderr, "Unknown profile <%s>, the valid profiles are:", argv[1]);
+            for (i = 0; i < profiles_len; i++) {
+                fprintf(stderr, " %s", bfutils_build_profiles[i].name);
+            }
+            fprintf(stderr, "\n");
+            exit(BFUTILS_BUILD_ERROR_UNKNOWN_PROFILE);
+        }
+        profile = bfutils_build_profiles[i];
     }
-    FILE *fp = fopen("target/stage1.ninja", "w");
+    bfutils_build_dir = bfutils_build_format("target/%s", profile.name);
+    #endif //BFUTILS_BUILD_PROFILES
+    bfutils_build_profile = profile;
+
+    bfutils_build_mkdir("target");
+    bfutils_build_mkdir(bfutils_build_dir);
+    char *path = bfutils_build_format("%s/bin", bfutils_build_dir);
+    bfutils_build_mkdir(path);
+    free(path);
+    path = bfutils_build_format("%s/objs", bfutils_build_dir);
+    bfutils_build_mkdir(path);
+    free(path);
+    FILE *fp = fopen("target/stage1.ninja.tmp", "w");
     if (fp == NULL) {
-        perror("Failed to open target/stage1.ninja");
+        perror("Failed to open target/stage1.ninja.tmp");
         exit(BFUTILS_BUILD_ERROR_OPEN);
     }
     fprintf(fp, "builddir = target\n");
@@ -172,11 +293,29 @@ int main(int argc, char *argv[]) {
     fprintf(fp, "ldflags = %s\n", BFUTILS_BUILD_LDFLAGS);
     fprintf(fp, "rule cc\n command = %s $cflags -MD -MF target/$out.d $in -o $out\n depfile = target/$out.d\n", cc);
     fprintf(fp, "rule cc2\n command = %s -DSTAGE2 $cflags -MD -MF $out.d $in -o $out\n depfile = $out.d\n", cc);
-    fprintf(fp, "rule rebuild\n command = target/build\n");
+    // The arguments are passed to the second stage quoted, so it selects the same profile.
+    fprintf(fp, "rule rebuild\n command = target/build");
+    for (int i = 1; i < argc; i++) {
+        fprintf(fp, " '");
+        for (char *c = argv[i]; *c; c++) {
+            if (*c == '\'') {
+                fprintf(fp, "'\\''");
+            }
+            else if (*c == '$') {
+                fprintf(fp, "$$");
+            }
+            else {
+                fputc(*c, fp);
+            }
+        }
+        fprintf(fp, "'");
+    }
+    fprintf(fp, "\n");
     fprintf(fp, "build build: cc build.c\n");
     fprintf(fp, "build target/build: cc2 build.c || build\n");
     fprintf(fp, "build stage2: rebuild || target/build\n");
     fclose(fp);
+    bfutils_build_update_file("target/stage1.ninja.tmp", "target/stage1.ninja");
     #ifndef STAGE2
     if (execlp("ninja", "ninja", "-f", "./target/stage1.ninja", NULL) < 0) {
         perror("Failed to run ninja");
@@ -184,219 +323,873 @@ int main(int argc, char *argv[]) {
     }
     #endif //STAGE2
 
-    fprintf(bfutils_build_fp, "builddir = target\n");
+    char *ninja_file = bfutils_build_format("%s/build.ninja", bfutils_build_dir);
+    char *ninja_tmp = bfutils_build_format("%s/build.ninja.tmp", bfutils_build_dir);
+    bfutils_build_fp = fopen(ninja_tmp, "w");
+    if (bfutils_build_fp == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", ninja_tmp, strerror(errno));
+        exit(BFUTILS_BUILD_ERROR_OPEN);
+    }
+    fprintf(bfutils_build_fp, "builddir = %s\n", bfutils_build_dir);
     fprintf(bfutils_build_fp, "cflags = %s\n", BFUTILS_BUILD_CFLAGS);
     fprintf(bfutils_build_fp, "ldflags = %s\n", BFUTILS_BUILD_LDFLAGS);
-    fprintf(bfutils_build_fp, "rule cc\n command = %s $cflags -MD -MF $out.d -c $in -o $out\n depfile = $out.d\n", cc);
-    fprintf(bfutils_build_fp, "rule link\n command = %s $in $ldflags -o $out\n", cc);
-    fprintf(bfutils_build_fp, "rule lib\n command = %s -shared $in $ldflags -o $out\n", cc);
+    fprintf(bfutils_build_fp, "profile_cflags = %s\n", profile.cflags);
+    fprintf(bfutils_build_fp, "profile_ldflags = %s\n", profile.ldflags);
+    char *compiler_cache = bfutils_build_find_compiler_cache();
+    fprintf(bfutils_build_fp, "rule cc\n command = %s%s%s $cflags $profile_cflags -MD -MF $out.d -c $in -o $out\n depfile = $out.d\n", compiler_cache ? compiler_cache : "", compiler_cache ? " " : "", cc);
+    fprintf(bfutils_build_fp, "rule link\n command = %s $in $ldflags $profile_ldflags -o $out\n", cc);
+    fprintf(bfutils_build_fp, "rule lib\n command = %s -shared $in $ldflags $profile_ldflags -o $out\n", cc);
+    fprintf(bfutils_build_fp, "rule ar\n command = rm -f $out && %s rcs $out $in\n", ar);
+    bfutils_build_clang = strstr(cc, "clang") != NULL;
+    if (bfutils_build_clang) {
+        fprintf(bfutils_build_fp, "rule pgo_train\n command = rm -f $pgo_dir/*.profraw && export LLVM_PROFILE_FILE=$pgo_dir/%%p.profraw BFUTILS_BUILD_PGO_BIN=$in && ( $train ) && llvm-profdata merge -output=$out $pgo_dir/*.profraw\n");
+    }
+    else {
+        fprintf(bfutils_build_fp, "rule pgo_train\n command = find $pgo_dir -name '*.gcda' -delete && export BFUTILS_BUILD_PGO_BIN=$in && ( $train ) && touch $out\n");
+    }
+    char *compdb_file = bfutils_build_format("%s/compile_commands.json", bfutils_build_dir);
+    char *compdb_tmp = bfutils_build_format("%s/compile_commands.json.tmp", bfutils_build_dir);
+    bfutils_build_compdb_fp = fopen(compdb_tmp, "w");
+    if (bfutils_build_compdb_fp == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", compdb_tmp, strerror(errno));
+        exit(BFUTILS_BUILD_ERROR_OPEN);
+    }
+    fprintf(bfutils_build_compdb_fp, "[");
     bfutils_build(argc, argv);
     fclose(bfutils_build_fp);
     bfutils_build_fp = NULL;
-    if (execlp("ninja", "ninja", "-f", "target/build.ninja", NULL) < 0) {
+    bfutils_build_update_file(ninja_tmp, ninja_file);
+    fprintf(bfutils_build_compdb_fp, "\n]\n");
+    fclose(bfutils_build_compdb_fp);
+    bfutils_build_compdb_fp = NULL;
+    bfutils_build_update_file(compdb_tmp, compdb_file);
+    // Only the default profile is copied to the root, so building another profile doesn't change the flags the tools see.
+    if (strcmp(profile.name, bfutils_build_profiles[0].name) == 0) {
+        bfutils_build_copy_file(compdb_file, "compile_commands.json.tmp", "compile_commands.json");
+    }
+    if (execlp("ninja", "ninja", "-f", ninja_file, NULL) < 0) {
         perror("Failed to run ninja");
         exit(BFUTILS_BUILD_ERROR_EXEC);
     }
 }
 
-char *bfutils_get_file_object(char *filename) {
-    int l = strlen(filename);
-    char *res = malloc((l+1) * sizeof(char));
-    strncpy(res, filename, l+1);
-    char *ext = strrchr(res, '.');
-    if (ext == NULL || strlen(ext) < 2) {
+static char *bfutils_build_format(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    char *res = malloc(length + 1);
+    va_start(args, format);
+    vsnprintf(res, length + 1, format, args);
+    va_end(args);
+    return res;
+}
+
+static int bfutils_build_same_content(FILE *a, FILE *b) {
+    char buffer_a[4096];
+    char buffer_b[4096];
+    size_t n;
+    while ((n = fread(buffer_a, sizeof(char), 4096, a)) > 0) {
+        if (fread(buffer_b, sizeof(char), n, b) != n || memcmp(buffer_a, buffer_b, n) != 0) {
+            return 0;
+        }
+    }
+    return fread(buffer_b, sizeof(char), 1, b) == 0;
+}
+
+// Moves tmp to path, unless path already has the same content.
+// Keeping the old file keeps its mtime, so ninja doesn't need to reload the manifest.
+static void bfutils_build_update_file(char *tmp, char *path) {
+    FILE *a = fopen(tmp, "r");
+    FILE *b = fopen(path, "r");
+    int same = a != NULL && b != NULL && bfutils_build_same_content(a, b);
+    if (a != NULL) fclose(a);
+    if (b != NULL) fclose(b);
+    if (same) {
+        unlink(tmp);
+    }
+    else if (rename(tmp, path) < 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+        exit(BFUTILS_BUILD_ERROR_OPEN);
+    }
+}
+
+// Copies src to path through tmp, so path keeps its mtime if it already has the same content.
+static void bfutils_build_copy_file(char *src, char *tmp, char *path) {
+    FILE *in = fopen(src, "r");
+    FILE *out = fopen(tmp, "w");
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "Failed to copy %s to %s: %s\n", src, path, strerror(errno));
+        exit(BFUTILS_BUILD_ERROR_OPEN);
+    }
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, sizeof(char), sizeof(buffer), in)) > 0) {
+        fwrite(buffer, sizeof(char), n, out);
+    }
+    fclose(in);
+    fclose(out);
+    bfutils_build_update_file(tmp, path);
+}
+
+// Ninja variables names can only have letters, digits, '_' and '-'.
+static char *bfutils_build_variable_name(char *prefix, char *name) {
+    char *res = malloc(strlen(prefix) + strlen(name) + 1);
+    sprintf(res, "%s%s", prefix, name);
+    for (char *c = res + strlen(prefix); *c; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-')) {
+            *c = '_';
+        }
+    }
+    return res;
+}
+
+typedef struct {
+    char *key;
+    char *value;
+} BFUtilsBuildStringEntry;
+
+// Open addressing hash map of strings, used to find the objects that were already defined.
+typedef struct {
+    BFUtilsBuildStringEntry *entries;
+    size_t capacity;
+    size_t length;
+} BFUtilsBuildStringMap;
+
+static size_t bfutils_build_string_hash(char *str) {
+    size_t hash = 14695981039346656037ULL;
+    for (; *str; str++) {
+        hash = (hash ^ (unsigned char) *str) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static BFUtilsBuildStringEntry *bfutils_build_map_slot(BFUtilsBuildStringEntry *entries, size_t capacity, char *key) {
+    size_t i = bfutils_build_string_hash(key) & (capacity - 1);
+    while (entries[i].key != NULL && strcmp(entries[i].key, key) != 0) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &entries[i];
+}
+
+static BFUtilsBuildStringEntry *bfutils_build_map_get(BFUtilsBuildStringMap *map, char *key) {
+    if (map->capacity == 0) {
+        return NULL;
+    }
+    BFUtilsBuildStringEntry *entry = bfutils_build_map_slot(map->entries, map->capacity, key);
+    return entry->key != NULL ? entry : NULL;
+}
+
+static void bfutils_build_map_put(BFUtilsBuildStringMap *map, char *key, char *value) {
+    if ((map->length + 1) * 4 > map->capacity * 3) {
+        size_t capacity = map->capacity > 0 ? map->capacity * 2 : 64;
+        BFUtilsBuildStringEntry *entries = calloc(capacity, sizeof(BFUtilsBuildStringEntry));
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->entries[i].key != NULL) {
+                *bfutils_build_map_slot(entries, capacity, map->entries[i].key) = map->entries[i];
+            }
+        }
+        free(map->entries);
+        map->entries = entries;
+        map->capacity = capacity;
+    }
+    BFUtilsBuildStringEntry *entry = bfutils_build_map_slot(map->entries, map->capacity, key);
+    if (entry->key == NULL) {
+        entry->key = strdup(key);
+        map->length++;
+    }
+    else {
+        free(entry->value);
+    }
+    entry->value = strdup(value);
+}
+
+static void bfutils_build_map_free(BFUtilsBuildStringMap *map) {
+    for (size_t i = 0; i < map->capacity; i++) {
+        free(map->entries[i].key);
+        free(map->entries[i].value);
+    }
+    free(map->entries);
+    *map = (BFUtilsBuildStringMap) {0};
+}
+
+// Maps each source file and its cflags, separated by a new line, to the object compiled from them.
+static BFUtilsBuildStringMap bfutils_build_objects = {0};
+// Maps each object path back to the source file and cflags it's compiled from.
+static BFUtilsBuildStringMap bfutils_build_object_paths = {0};
+
+// Returns the object path of a source file, mirroring its directory under dir.
+// ".." is replaced by "__", so files outside of the project root are kept inside dir.
+char *bfutils_get_file_object(char *dir, char *filename) {
+    char *ext = strrchr(filename, '.');
+    if (ext == NULL || strlen(ext) < 2 || strchr(ext, '/') != NULL) {
         fprintf(stderr, "Invalid source file name <%s>\n", filename);
         exit(BFUTILS_BUILD_ERROR_INVALID_FILENAME);
     }
-    ext[1] = 'o';
-    ext[2] = '\0';
+    char *res = malloc(strlen(dir) + strlen(filename) + 4);
+    char *end = res + sprintf(res, "%s/", dir);
+    char *segment = filename;
+    while (segment < ext) {
+        size_t l = strcspn(segment, "/");
+        if (l == 2 && strncmp(segment, "..", 2) == 0) {
+            end += sprintf(end, "__/");
+        }
+        else if (l > 0 && !(l == 1 && segment[0] == '.') && segment + l < ext) {
+            end += sprintf(end, "%.*s/", (int) l, segment);
+        }
+        else if (segment + l >= ext) {
+            end += sprintf(end, "%.*s", (int) (ext - segment), segment);
+        }
+        segment += l + 1;
+    }
+    sprintf(end, ".o");
     return res;
 }
 
-static int bfutils_build_check_duplicate(char *file) {
-    for (int i = 0; i < bfutils_build_source_files_len; i++) {
-        if (strcmp(file, bfutils_build_source_files[i]) == 0) {
-            return 1;
+// Returns the object path of a source file that belongs to a single target.
+// The source extension is kept, so "util.c" and "util.S" of the same target get different objects.
+static char *bfutils_build_target_object(char *dir, char *filename) {
+    char *obj = bfutils_get_file_object(dir, filename);
+    char *res = bfutils_build_format("%.*s%s.o", (int) (strlen(obj) - 2), obj, strrchr(filename, '.'));
+    free(obj);
+    return res;
+}
+
+// Returns the source path without "." segments and repeated slashes, so each file has a single name.
+static char *bfutils_build_source_path(char *filename) {
+    char *res = malloc(strlen(filename) + 1);
+    char *end = res;
+    if (filename[0] == '/') {
+        *end++ = '/';
+    }
+    for (char *segment = filename; *segment;) {
+        size_t l = strcspn(segment, "/");
+        if (l > 0 && !(l == 1 && segment[0] == '.')) {
+            if (end > res && end[-1] != '/') {
+                *end++ = '/';
+            }
+            memcpy(end, segment, l);
+            end += l;
+        }
+        segment += l;
+        if (*segment == '/') {
+            segment++;
         }
     }
-    bfutils_build_source_files[bfutils_build_source_files_len++] = file;
-    return 0;
+    *end = '\0';
+    return res;
 }
 
-static char *bfutils_pkg_config_cflags(char *dep) {
-    if(dep == NULL) {
-        return NULL;
+typedef struct {
+    char *dep;
+    char *pc_file;
+    time_t mtime;
+    char *cflags;
+    char *ldflags;
+} BFUtilsBuildPkgConfig;
+
+#define BFUTILS_BUILD_PKG_CONFIG_CACHE "target/pkg-config.cache"
+
+static BFUtilsBuildPkgConfig *bfutils_build_pkg_configs = NULL;
+static int bfutils_build_pkg_configs_len = 0;
+static int bfutils_build_pkg_configs_loaded = 0;
+
+static void bfutils_build_pkg_config_push(BFUtilsBuildPkgConfig pkg) {
+    bfutils_build_pkg_configs = realloc(bfutils_build_pkg_configs, sizeof(BFUtilsBuildPkgConfig) * (bfutils_build_pkg_configs_len + 1));
+    bfutils_build_pkg_configs[bfutils_build_pkg_configs_len++] = pkg;
+}
+
+static BFUtilsBuildPkgConfig *bfutils_build_pkg_config_find(char *dep) {
+    for (int i = 0; i < bfutils_build_pkg_configs_len; i++) {
+        if (strcmp(dep, bfutils_build_pkg_configs[i].dep) == 0) {
+            return &bfutils_build_pkg_configs[i];
+        }
     }
+    return NULL;
+}
 
-    char cmd[strlen(dep) + 21];
-    sprintf(cmd, "pkg-config --cflags %s", dep);
-    FILE *p = popen(cmd, "r");
-    
-    char buffer[1024];
+// The cache is only valid for the same PKG_CONFIG_PATH, so it's written on the first line.
+static char *bfutils_build_pkg_config_cache_header() {
+    char *path = getenv("PKG_CONFIG_PATH");
+    if (path == NULL) {
+        path = "";
+    }
+    char *header = malloc(strlen(path) + 18);
+    sprintf(header, "PKG_CONFIG_PATH=%s\n", path);
+    return header;
+}
 
-    char *res = NULL;
-    size_t i = 0;
-    size_t n;
-    do {
-        n = fread(buffer, sizeof(char), 1024, p);
-        res = realloc(res, sizeof(char) * (i + n + 1));
-        strncpy(res + i, buffer, n);
-        i += n;
-    } while(n == 1024);
-    if (pclose(p) != 0) {
-        free(res);
-        exit(BFUTILS_BUILD_ERROR_PKG_CONFIG);
+// Loads the results of previous runs whose .pc file didn't change since they were cached.
+// Each line has the dep, the .pc file, its mtime, the cflags and the ldflags separated by tabs.
+static void bfutils_build_pkg_config_load() {
+    bfutils_build_pkg_configs_loaded = 1;
+    FILE *fp = fopen(BFUTILS_BUILD_PKG_CONFIG_CACHE, "r");
+    if (fp == NULL) {
+        return;
     }
-    res[i -1] = '\0';
-    return res;
+    char *header = bfutils_build_pkg_config_cache_header();
+    char *line = NULL;
+    size_t line_capacity = 0;
+    if (getline(&line, &line_capacity, fp) < 0 || strcmp(line, header) != 0) {
+        free(header);
+        free(line);
+        fclose(fp);
+        return;
+    }
+    free(header);
+
+    ssize_t n;
+    while ((n = getline(&line, &line_capacity, fp)) > 0) {
+        if (line[n - 1] == '\n') {
+            line[n - 1] = '\0';
+        }
+        char *fields[5];
+        char *field = line;
+        int fields_len = 0;
+        while (fields_len < 5 && field != NULL) {
+            fields[fields_len++] = field;
+            field = strchr(field, '\t');
+            if (field != NULL) {
+                *field++ = '\0';
+            }
+        }
+        if (fields_len < 5) {
+            continue;
+        }
+        time_t mtime = (time_t) strtoll(fields[2], NULL, 10);
+        struct stat st;
+        if (stat(fields[1], &st) < 0 || st.st_mtime != mtime) {
+            continue;
+        }
+        bfutils_build_pkg_config_push((BFUtilsBuildPkgConfig) {
+            .dep = strdup(fields[0]),
+            .pc_file = strdup(fields[1]),
+            .mtime = mtime,
+            .cflags = strdup(fields[3]),
+            .ldflags = strdup(fields[4]),
+        });
+    }
+    free(line);
+    fclose(fp);
 }
 
-static char *bfutils_pkg_config_ldflags(char *dep) {
-    if(dep == NULL) {
-        return NULL;
+static void bfutils_build_pkg_config_save() {
+    FILE *fp = fopen(BFUTILS_BUILD_PKG_CONFIG_CACHE ".tmp", "w");
+    if (fp == NULL) {
+        return;
     }
+    char *header = bfutils_build_pkg_config_cache_header();
+    fputs(header, fp);
+    free(header);
+    for (int i = 0; i < bfutils_build_pkg_configs_len; i++) {
+        BFUtilsBuildPkgConfig *pkg = &bfutils_build_pkg_configs[i];
+        fprintf(fp, "%s\t%s\t%lld\t%s\t%s\n", pkg->dep, pkg->pc_file, (long long) pkg->mtime, pkg->cflags, pkg->ldflags);
+    }
+    fclose(fp);
+    rename(BFUTILS_BUILD_PKG_CONFIG_CACHE ".tmp", BFUTILS_BUILD_PKG_CONFIG_CACHE);
+}
 
-    char cmd[strlen(dep) + 21];
-    sprintf(cmd, "pkg-config --libs %s", dep);
+static FILE *bfutils_build_pkg_config_open(char *option, char *dep) {
+    char cmd[strlen(option) + strlen(dep) + 14];
+    sprintf(cmd, "pkg-config %s %s", option, dep);
     FILE *p = popen(cmd, "r");
-    
-    char buffer[1024];
+    if (p == NULL) {
+        perror("Failed to run pkg-config");
+        exit(BFUTILS_BUILD_ERROR_PKG_CONFIG);
+    }
+    return p;
+}
 
-    char *res = NULL;
+static char *bfutils_build_pkg_config_read(FILE *p, char *dep) {
+    char buffer[1024];
+    char *res = malloc(1);
     size_t i = 0;
     size_t n;
-    do {
-        n = fread(buffer, sizeof(char), 1024, p);
+    while ((n = fread(buffer, sizeof(char), 1024, p)) > 0) {
         res = realloc(res, sizeof(char) * (i + n + 1));
-        strncpy(res + i, buffer, n);
+        memcpy(res + i, buffer, n);
         i += n;
-    } while(n == 1024);
+    }
     if (pclose(p) != 0) {
-        free(res);
+        fprintf(stderr, "pkg-config failed for <%s>\n", dep);
         exit(BFUTILS_BUILD_ERROR_PKG_CONFIG);
     }
-    res[i - 1] = '\0';
+    while (i > 0 && (res[i - 1] == '\n' || res[i - 1] == ' ')) {
+        i--;
+    }
+    res[i] = '\0';
     return res;
 }
 
-void bfutils_add_shared_library_fn(BFUtilsBuildCfg cfg, char *file, int line) {
-    if (bfutils_build_fp == NULL) {
-        fprintf(stderr, "Error on %s:%d - bfutils_add_executable must be called inside bfutils_build function\n", file, line);
-        exit(BFUTILS_BUILD_ERROR_OUTSIDE_FUNCTION);
+// Resolves the deps that are not cached yet. All pkg-config processes are started before reading any of them, so they run concurrently.
+static void bfutils_build_pkg_config_resolve(char **deps, int deps_len) {
+    if (!bfutils_build_pkg_configs_loaded) {
+        bfutils_build_pkg_config_load();
     }
-    if (cfg.name == NULL || strlen(cfg.name) == 0) {
-        fprintf(stderr, "Error on %s:%d - An executable must have a valid name\n", file, line);
-        exit(BFUTILS_BUILD_ERROR_MISSING_NAME);
+    char **pending = malloc(sizeof(char *) * deps_len);
+    FILE **pipes = malloc(sizeof(FILE *) * deps_len * 3);
+    int pending_len = 0;
+    for (int i = 0; i < deps_len; i++) {
+        if (deps[i] == NULL || bfutils_build_pkg_config_find(deps[i]) != NULL) {
+            continue;
+        }
+        int duplicate = 0;
+        for (int j = 0; j < pending_len && !duplicate; j++) {
+            duplicate = strcmp(deps[i], pending[j]) == 0;
+        }
+        if (duplicate) {
+            continue;
+        }
+        pipes[pending_len * 3] = bfutils_build_pkg_config_open("--cflags", deps[i]);
+        pipes[pending_len * 3 + 1] = bfutils_build_pkg_config_open("--libs", deps[i]);
+        pipes[pending_len * 3 + 2] = bfutils_build_pkg_config_open("--variable=pcfiledir", deps[i]);
+        pending[pending_len++] = deps[i];
     }
-    if (cfg.files_len <= 0) {
-        fprintf(stderr, "Error on %s:%d - An executable must have source files\n", file, line);
-        exit(BFUTILS_BUILD_ERROR_MISSING_FILE);
+
+    for (int i = 0; i < pending_len; i++) {
+        BFUtilsBuildPkgConfig pkg = {.dep = strdup(pending[i])};
+        pkg.cflags = bfutils_build_pkg_config_read(pipes[i * 3], pending[i]);
+        pkg.ldflags = bfutils_build_pkg_config_read(pipes[i * 3 + 1], pending[i]);
+        char *dir = bfutils_build_pkg_config_read(pipes[i * 3 + 2], pending[i]);
+        pkg.pc_file = malloc(strlen(dir) + strlen(pending[i]) + 5);
+        sprintf(pkg.pc_file, "%s/%s.pc", dir, pending[i]);
+        free(dir);
+        struct stat st;
+        if (stat(pkg.pc_file, &st) == 0) {
+            pkg.mtime = st.st_mtime;
+        }
+        bfutils_build_pkg_config_push(pkg);
     }
-    char **objs = malloc(sizeof(char *) * cfg.files_len);
-    int objs_len = 0;
-    for (int i = 0; i < cfg.files_len; i++) {
-        char *file = basename(cfg.files[i]);
-        if (bfutils_build_check_duplicate(file)) {
-            continue;
+    if (pending_len > 0) {
+        bfutils_build_pkg_config_save();
+    }
+    free(pipes);
+    free(pending);
+}
+
+// Returns the cflags (or ldflags) of all deps, each one preceded by a space.
+static char *bfutils_build_pkg_config_flags(char **deps, int deps_len, int ldflags) {
+    bfutils_build_pkg_config_resolve(deps, deps_len);
+    size_t length = 0;
+    for (int i = 0; i < deps_len; i++) {
+        if (deps[i] == NULL) continue;
+        BFUtilsBuildPkgConfig *pkg = bfutils_build_pkg_config_find(deps[i]);
+        length += strlen(ldflags ? pkg->ldflags : pkg->cflags) + 1;
+    }
+    char *res = malloc(length + 1);
+    res[0] = '\0';
+    char *end = res;
+    for (int i = 0; i < deps_len; i++) {
+        if (deps[i] == NULL) continue;
+        BFUtilsBuildPkgConfig *pkg = bfutils_build_pkg_config_find(deps[i]);
+        end += sprintf(end, " %s", ldflags ? pkg->ldflags : pkg->cflags);
+    }
+    return res;
+}
+
+typedef enum {
+    BFUTILS_BUILD_EXECUTABLE,
+    BFUTILS_BUILD_SHARED_LIBRARY,
+    BFUTILS_BUILD_STATIC_LIBRARY,
+} BFUtilsBuildTargetType;
+
+typedef struct {
+    char *name;
+    BFUtilsBuildTargetType type;
+    char *path;
+    char *ldflags;
+} BFUtilsBuildTarget;
+
+static BFUtilsBuildTarget *bfutils_build_targets = NULL;
+static int bfutils_build_targets_len = 0;
+
+static BFUtilsBuildTarget *bfutils_build_find_target(char *name) {
+    for (int i = 0; i < bfutils_build_targets_len; i++) {
+        if (strcmp(name, bfutils_build_targets[i].name) == 0) {
+            return &bfutils_build_targets[i];
         }
-        char *obj = bfutils_get_file_object(file);
-        objs[objs_len++] = obj;
-        fprintf(bfutils_build_fp, "build target/objs/%s: cc %s\n", obj, cfg.files[i]);
-        if (cfg.deps_len > 0) {
-            char *other_flags = cfg.cflags ? cfg.cflags : BFUTILS_BUILD_CFLAGS;
-            fprintf(bfutils_build_fp, " cflags = -fPIC");
-            for (int i = 0; i < cfg.deps_len; i++) {
-                char *val = bfutils_pkg_config_cflags(cfg.deps[i]);
-                fprintf(bfutils_build_fp, " %s", val);
-                free(val);
-            }
-            fprintf(bfutils_build_fp, " %s\n", other_flags);
+    }
+    return NULL;
+}
+
+static char *bfutils_build_concat(char *str, char *suffix) {
+    size_t l = str ? strlen(str) : 0;
+    str = realloc(str, l + strlen(suffix) + 1);
+    strcpy(str + l, suffix);
+    return str;
+}
+
+// Writes the unity translation unit that includes the files [begin, end) of the target.
+static char *bfutils_build_unity_file(char *name, int index, char **files, int begin, int end) {
+    char *dir = bfutils_build_format("%s/unity", bfutils_build_dir);
+    bfutils_build_mkdir(dir);
+    dir = bfutils_build_concat(dir, "/");
+    dir = bfutils_build_concat(dir, name);
+    bfutils_build_mkdir(dir);
+    char *path = bfutils_build_format("%s/%d.c", dir, index);
+    char *tmp = bfutils_build_format("%s.tmp", path);
+    // The files are relative to the project root, which is one "../" up for each directory of the path.
+    char *root = bfutils_build_concat(NULL, "../");
+    for (char *c = dir; *c; c++) {
+        if (*c == '/') {
+            root = bfutils_build_concat(root, "../");
+        }
+    }
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", tmp, strerror(errno));
+        exit(BFUTILS_BUILD_ERROR_OPEN);
+    }
+    for (int i = begin; i < end; i++) {
+        fprintf(fp, "#include \"%s%s\"\n", files[i][0] == '/' ? "" : root, files[i]);
+    }
+    fclose(fp);
+    bfutils_build_update_file(tmp, path);
+    free(root);
+    free(tmp);
+    free(dir);
+    return path;
+}
+
+static void bfutils_build_write_json_string(FILE *fp, char *str) {
+    fputc('"', fp);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', fp);
         }
-        else if (cfg.cflags) {
-            fprintf(bfutils_build_fp, " cflags = -fPIC %s\n", cfg.cflags);
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+// Adds the compilation of a source file to compile_commands.json.
+static void bfutils_build_add_compile_command(char *source, char *obj, char *cflags, char *extra_flags) {
+    char directory[4096];
+    if (getcwd(directory, sizeof(directory)) == NULL) {
+        strcpy(directory, ".");
+    }
+    char *command = bfutils_build_format("%s %s %s%s -c %s -o %s", bfutils_build_cc, cflags ? cflags : BFUTILS_BUILD_CFLAGS, bfutils_build_profile.cflags, extra_flags ? extra_flags : "", source, obj);
+    FILE *fp = bfutils_build_compdb_fp;
+    fprintf(fp, "%s\n  {\n    \"directory\": ", bfutils_build_compdb_len++ > 0 ? "," : "");
+    bfutils_build_write_json_string(fp, directory);
+    fprintf(fp, ",\n    \"command\": ");
+    bfutils_build_write_json_string(fp, command);
+    fprintf(fp, ",\n    \"file\": ");
+    bfutils_build_write_json_string(fp, source);
+    fprintf(fp, ",\n    \"output\": ");
+    bfutils_build_write_json_string(fp, obj);
+    fprintf(fp, "\n  }");
+    free(command);
+}
+
+// Writes the build edge of a target with its objects and libraries.
+// Static libraries are linked by path, the others are implicit dependencies of this target.
+static void bfutils_build_write_target(char *rule, char *path, char **objs, int objs_len, BFUtilsBuildTarget **libs, int libs_len, int archive) {
+    fprintf(bfutils_build_fp, "build %s: %s", path, rule);
+    for (int i = 0; i < objs_len; i++) {
+        fprintf(bfutils_build_fp, " %s", objs[i]);
+    }
+    int implicit = 0;
+    for (int i = 0; i < libs_len; i++) {
+        if (libs[i]->type == BFUTILS_BUILD_STATIC_LIBRARY && !archive) {
+            fprintf(bfutils_build_fp, " %s", libs[i]->path);
         }
         else {
-            fprintf(bfutils_build_fp, " cflags = -fPIC %s\n", BFUTILS_BUILD_CFLAGS);
+            implicit = 1;
         }
     }
-    fprintf(bfutils_build_fp, "build target/lib/lib%s.so: lib", cfg.name);
-    for (int i = 0; i < objs_len; i++) {
-        fprintf(bfutils_build_fp, " target/objs/%s", objs[i]);
-        free(objs[i]);
+    if (implicit) {
+        fprintf(bfutils_build_fp, " |");
+        for (int i = 0; i < libs_len; i++) {
+            if (libs[i]->type != BFUTILS_BUILD_STATIC_LIBRARY || archive) {
+                fprintf(bfutils_build_fp, " %s", libs[i]->path);
+            }
+        }
     }
-    free(objs);
     fprintf(bfutils_build_fp, "\n");
-    if (cfg.deps_len > 0) {
-        char *other_flags = cfg.ldflags ? cfg.ldflags : BFUTILS_BUILD_LDFLAGS;
-        fprintf(bfutils_build_fp, " ldflags =");
-        for (int i = 0; i < cfg.deps_len; i++) {
-            char *val = bfutils_pkg_config_ldflags(cfg.deps[i]);
-            fprintf(bfutils_build_fp, " %s", val);
-            free(val);
+}
+
+// Writes a ninja variable value, escaping the '$' characters.
+static void bfutils_build_write_escaped(char *value) {
+    for (; *value; value++) {
+        if (*value == '$') {
+            fputc('$', bfutils_build_fp);
         }
-        fprintf(bfutils_build_fp, " %s\n", other_flags);
+        fputc(*value, bfutils_build_fp);
+    }
+}
+
+// Builds an instrumented variant of the executable on target/pgo/<name> and runs the training command with it.
+// Returns the path of the profile, which is updated after each training.
+static char *bfutils_build_add_pgo_train(BFUtilsBuildCfg cfg, char *name, char **sources, int sources_len, char *cflags_value, char *ldflags, int shared_libs, BFUtilsBuildTarget **libs) {
+    char *dir = bfutils_build_format("%s/pgo/%s", bfutils_build_dir, name);
+    char objs_dir[strlen(dir) + 6];
+    sprintf(objs_dir, "%s/objs", dir);
+    char *generate = bfutils_build_clang ? "-fprofile-instr-generate" : "-fprofile-generate";
+
+    char **objs = malloc(sizeof(char *) * sources_len);
+    fprintf(bfutils_build_fp, "cflags_pgo_%s =%s %s\n", name, cflags_value, generate);
+    for (int i = 0; i < sources_len; i++) {
+        objs[i] = bfutils_build_target_object(objs_dir, sources[i]);
+        fprintf(bfutils_build_fp, "build %s: cc %s\n", objs[i], sources[i]);
+        fprintf(bfutils_build_fp, " cflags = $cflags_pgo_%s\n", name);
     }
-    else if (cfg.ldflags) {
-        fprintf(bfutils_build_fp, " ldflags = %s\n", cfg.ldflags);
+    char bin[strlen(dir) + strlen(cfg.name) + 6];
+    sprintf(bin, "%s/bin/%s", dir, cfg.name);
+    bfutils_build_write_target("link", bin, objs, sources_len, libs, cfg.libs_len, 0);
+    fprintf(bfutils_build_fp, " ldflags =%s%s %s\n", ldflags ? ldflags : " " BFUTILS_BUILD_LDFLAGS, shared_libs ? " -Wl,-rpath,'$$ORIGIN/../../../lib'" : "", generate);
+    for (int i = 0; i < sources_len; i++) {
+        free(objs[i]);
     }
+    free(objs);
+
+    char *profile = malloc(strlen(dir) + 9);
+    sprintf(profile, "%s/profile", dir);
+    fprintf(bfutils_build_fp, "build %s: pgo_train %s\n", profile, bin);
+    fprintf(bfutils_build_fp, " pgo_dir = %s\n", dir);
+    fprintf(bfutils_build_fp, " train = ");
+    bfutils_build_write_escaped(cfg.pgo_train);
+    fprintf(bfutils_build_fp, "\n");
+    free(dir);
+    return profile;
 }
 
-void bfutils_add_executable_fn(BFUtilsBuildCfg cfg, char *file, int line) {
+static void bfutils_build_add_target(BFUtilsBuildCfg cfg, BFUtilsBuildTargetType type, char *file, int line) {
     if (bfutils_build_fp == NULL) {
-        fprintf(stderr, "Error on %s:%d - bfutils_add_executable must be called inside bfutils_build function\n", file, line);
+        fprintf(stderr, "Error on %s:%d - Targets must be added inside bfutils_build function\n", file, line);
         exit(BFUTILS_BUILD_ERROR_OUTSIDE_FUNCTION);
     }
     if (cfg.name == NULL || strlen(cfg.name) == 0) {
-        fprintf(stderr, "Error on %s:%d - An executable must have a valid name\n", file, line);
+        fprintf(stderr, "Error on %s:%d - A target must have a valid name\n", file, line);
         exit(BFUTILS_BUILD_ERROR_MISSING_NAME);
     }
     if (cfg.files_len <= 0) {
-        fprintf(stderr, "Error on %s:%d - An executable must have source files\n", file, line);
+        fprintf(stderr, "Error on %s:%d - A target must have source files\n", file, line);
         exit(BFUTILS_BUILD_ERROR_MISSING_FILE);
     }
-    char **objs = malloc(sizeof(char *) * cfg.files_len);
-    int objs_len = 0;
-    for (int i = 0; i < cfg.files_len; i++) {
-        char *file = basename(cfg.files[i]);
-        if (bfutils_build_check_duplicate(file)) {
+    BFUtilsBuildTarget **libs = malloc(sizeof(BFUtilsBuildTarget *) * (cfg.libs_len + 1));
+    for (int i = 0; i < cfg.libs_len; i++) {
+        libs[i] = bfutils_build_find_target(cfg.libs[i]);
+        if (libs[i] == NULL || libs[i]->type == BFUTILS_BUILD_EXECUTABLE) {
+            fprintf(stderr, "Error on %s:%d - <%s> must be a library defined before <%s>\n", file, line, cfg.libs[i], cfg.name);
+            exit(BFUTILS_BUILD_ERROR_MISSING_LIBRARY);
+        }
+    }
+    int pgo = cfg.pgo_train != NULL && type == BFUTILS_BUILD_EXECUTABLE;
+    char *name = bfutils_build_variable_name("", cfg.name);
+    // The sanitized name is used for variables and directories, so it must be unique too.
+    for (int i = 0; i < bfutils_build_targets_len; i++) {
+        char *other = bfutils_build_variable_name("", bfutils_build_targets[i].name);
+        int same = strcmp(name, other) == 0;
+        free(other);
+        if (same) {
+            fprintf(stderr, "Error on %s:%d - <%s> has the same name as <%s> once sanitized to <%s>\n", file, line, cfg.name, bfutils_build_targets[i].name, name);
+            exit(BFUTILS_BUILD_ERROR_DUPLICATE_NAME);
+        }
+    }
+
+    char *cflags = NULL;
+    char *cflags_value = NULL;
+    // Static libraries are position independent too, since they may be linked to a shared library.
+    int pic = type != BFUTILS_BUILD_EXECUTABLE;
+    if (cfg.deps_len > 0 || cfg.cflags || pic || cfg.lto || pgo) {
+        cflags = bfutils_build_variable_name("cflags_", cfg.name);
+        char *other_flags = cfg.cflags ? cfg.cflags : BFUTILS_BUILD_CFLAGS;
+        char *deps_cflags = cfg.deps_len > 0 ? bfutils_build_pkg_config_flags(cfg.deps, cfg.deps_len, 0) : NULL;
+        cflags_value = malloc(strlen(other_flags) + (deps_cflags ? strlen(deps_cflags) : 0) + 24);
+        sprintf(cflags_value, "%s%s %s%s", pic ? " -fPIC" : "", deps_cflags ? deps_cflags : "", other_flags, cfg.lto ? " -flto=auto" : "");
+        free(deps_cflags);
+    }
+
+    char *ldflags = NULL;
+    int shared_libs = 0;
+    if (cfg.deps_len > 0) {
+        ldflags = bfutils_build_pkg_config_flags(cfg.deps, cfg.deps_len, 1);
+    }
+    for (int i = 0; i < cfg.libs_len; i++) {
+        if (libs[i]->type == BFUTILS_BUILD_SHARED_LIBRARY) {
+            char *flags = bfutils_build_format(" -L%s/lib -l%s", bfutils_build_dir, libs[i]->name);
+            ldflags = bfutils_build_concat(ldflags, flags);
+            free(flags);
+            shared_libs = 1;
+        }
+        if (libs[i]->ldflags) {
+            ldflags = bfutils_build_concat(ldflags, libs[i]->ldflags);
+        }
+    }
+    if (cfg.ldflags || (type != BFUTILS_BUILD_STATIC_LIBRARY && (ldflags || cfg.lto))) {
+        ldflags = bfutils_build_concat(ldflags, " ");
+        ldflags = bfutils_build_concat(ldflags, cfg.ldflags ? cfg.ldflags : BFUTILS_BUILD_LDFLAGS);
+    }
+    if (cfg.lto && type != BFUTILS_BUILD_STATIC_LIBRARY) {
+        ldflags = bfutils_build_concat(ldflags, " -flto=auto");
+    }
+    char *rpath = shared_libs && type != BFUTILS_BUILD_STATIC_LIBRARY ? " -Wl,-rpath,'$$ORIGIN/../lib'" : "";
+
+    // The sources of the target, without duplicates. Files with the same stem are kept, since they get different objects.
+    int sources_len = cfg.unity > 0 ? (cfg.files_len + cfg.unity - 1) / cfg.unity : cfg.files_len;
+    char **sources = malloc(sizeof(char *) * sources_len);
+    int unique_len = 0;
+    BFUtilsBuildStringMap target_sources = {0};
+    for (int i = 0; i < sources_len; i++) {
+        if (cfg.unity > 0) {
+            int end = (i + 1) * cfg.unity < cfg.files_len ? (i + 1) * cfg.unity : cfg.files_len;
+            sources[unique_len++] = bfutils_build_unity_file(name, i, cfg.files, i * cfg.unity, end);
             continue;
         }
-        char *obj = bfutils_get_file_object(file);
-        objs[objs_len++] = obj;
-        fprintf(bfutils_build_fp, "build target/objs/%s: cc %s\n", obj, cfg.files[i]);
-        if (cfg.deps_len > 0) {
-            char *other_flags = cfg.cflags ? cfg.cflags : BFUTILS_BUILD_CFLAGS;
-            fprintf(bfutils_build_fp, " cflags =");
-            for (int i = 0; i < cfg.deps_len; i++) {
-                char *val = bfutils_pkg_config_cflags(cfg.deps[i]);
-                fprintf(bfutils_build_fp, " %s", val);
-                free(val);
-            }
-            fprintf(bfutils_build_fp, " %s\n", other_flags);
+        char *source = bfutils_build_source_path(cfg.files[i]);
+        if (bfutils_build_map_get(&target_sources, source) == NULL) {
+            bfutils_build_map_put(&target_sources, source, "");
+            sources[unique_len++] = source;
         }
-        else if (cfg.cflags) {
-            fprintf(bfutils_build_fp, " cflags = %s\n", cfg.cflags);
+        else {
+            free(source);
         }
     }
-    fprintf(bfutils_build_fp, "build target/bin/%s: link", cfg.name);
-    for (int i = 0; i < objs_len; i++) {
-        fprintf(bfutils_build_fp, " target/objs/%s", objs[i]);
+    bfutils_build_map_free(&target_sources);
+    sources_len = unique_len;
+
+    char *profile = NULL;
+    if (pgo) {
+        profile = bfutils_build_add_pgo_train(cfg, name, sources, sources_len, cflags_value, ldflags, shared_libs, libs);
+        if (bfutils_build_clang) {
+            cflags_value = bfutils_build_concat(cflags_value, " -fprofile-instr-use=");
+            cflags_value = bfutils_build_concat(cflags_value, profile);
+        }
+        else {
+            cflags_value = bfutils_build_concat(cflags_value, " -fprofile-use -fprofile-correction -Wno-missing-profile");
+        }
+    }
+    if (cflags) {
+        fprintf(bfutils_build_fp, "%s =%s\n", cflags, cflags_value);
+    }
+
+    char *shared_objs_dir = bfutils_build_format("%s/objs", bfutils_build_dir);
+    // Objects that can't be shared are placed under a hidden directory, away from the mirrored source paths.
+    char *objs_dir = bfutils_build_format("%s/objs/.targets/%s", bfutils_build_dir, name);
+    char *pgo_objs_dir = bfutils_build_format("%s/pgo/%s/objs", bfutils_build_dir, name);
+    char **objs = malloc(sizeof(char *) * sources_len);
+    for (int i = 0; i < sources_len; i++) {
+        // The object is shared between targets only if it's compiled from the same source with the same flags.
+        // PGO objects depend on the profile of this target, so they are never shared.
+        char *key = bfutils_build_format("%s\n%s", sources[i], cflags_value ? cflags_value : "");
+        BFUtilsBuildStringEntry *entry = pgo ? NULL : bfutils_build_map_get(&bfutils_build_objects, key);
+        if (entry != NULL) {
+            objs[i] = strdup(entry->value);
+            free(key);
+            free(sources[i]);
+            continue;
+        }
+        char *obj = pgo ? bfutils_build_target_object(objs_dir, sources[i]) : bfutils_get_file_object(shared_objs_dir, sources[i]);
+        entry = bfutils_build_map_get(&bfutils_build_object_paths, obj);
+        if (entry != NULL && !pgo) {
+            // Another source or other flags already use this path, so the target gets its own copy.
+            free(obj);
+            obj = bfutils_build_target_object(objs_dir, sources[i]);
+            entry = bfutils_build_map_get(&bfutils_build_object_paths, obj);
+        }
+        if (entry != NULL && strcmp(entry->value, key) != 0) {
+            fprintf(stderr, "Error on %s:%d - The object of <%s> on <%s> conflicts with %s\n", file, line, sources[i], cfg.name, obj);
+            exit(BFUTILS_BUILD_ERROR_OBJECT_CONFLICT);
+        }
+        objs[i] = obj;
+        if (entry == NULL) {
+            if (!pgo) {
+                bfutils_build_map_put(&bfutils_build_objects, key, obj);
+            }
+            bfutils_build_map_put(&bfutils_build_object_paths, obj, key);
+            if (pgo) {
+                fprintf(bfutils_build_fp, "build %s: cc %s | %s\n", obj, sources[i], profile);
+            }
+            else {
+                fprintf(bfutils_build_fp, "build %s: cc %s\n", obj, sources[i]);
+            }
+            char *dumpbase = NULL;
+            if (pgo && !bfutils_build_clang) {
+                // gcc looks for the profile of the instrumented object, named after its dumpbase.
+                char *instrumented = bfutils_build_target_object(pgo_objs_dir, sources[i]);
+                instrumented[strlen(instrumented) - 2] = '\0';
+                dumpbase = bfutils_build_format(" -dumpbase %s", instrumented);
+                free(instrumented);
+            }
+            if (cflags) {
+                fprintf(bfutils_build_fp, " cflags = $%s%s\n", cflags, dumpbase ? dumpbase : "");
+            }
+            if (cfg.unity > 0) {
+                // Each file of the unity translation unit gets an entry, so the tools can find their flags.
+                int end = (i + 1) * cfg.unity < cfg.files_len ? (i + 1) * cfg.unity : cfg.files_len;
+                for (int j = i * cfg.unity; j < end; j++) {
+                    bfutils_build_add_compile_command(cfg.files[j], obj, cflags_value, dumpbase);
+                }
+            }
+            else {
+                bfutils_build_add_compile_command(sources[i], obj, cflags_value, dumpbase);
+            }
+            free(dumpbase);
+        }
+        free(key);
+        free(sources[i]);
+    }
+    free(sources);
+    free(shared_objs_dir);
+    free(objs_dir);
+    free(pgo_objs_dir);
+    free(profile);
+    free(name);
+    free(cflags);
+    free(cflags_value);
+
+    BFUtilsBuildTarget target = {.name = strdup(cfg.name), .type = type};
+    switch (type) {
+        case BFUTILS_BUILD_EXECUTABLE:
+            target.path = bfutils_build_format("%s/bin/%s", bfutils_build_dir, cfg.name);
+            bfutils_build_write_target("link", target.path, objs, sources_len, libs, cfg.libs_len, 0);
+            break;
+        case BFUTILS_BUILD_SHARED_LIBRARY:
+            target.path = bfutils_build_format("%s/lib/lib%s.so", bfutils_build_dir, cfg.name);
+            bfutils_build_write_target("lib", target.path, objs, sources_len, libs, cfg.libs_len, 0);
+            break;
+        case BFUTILS_BUILD_STATIC_LIBRARY:
+            target.path = bfutils_build_format("%s/lib/lib%s.a", bfutils_build_dir, cfg.name);
+            bfutils_build_write_target("ar", target.path, objs, sources_len, libs, cfg.libs_len, 1);
+            break;
+    }
+    for (int i = 0; i < sources_len; i++) {
         free(objs[i]);
     }
     free(objs);
-    fprintf(bfutils_build_fp, "\n");
-    if (cfg.deps_len > 0) {
-        char *other_flags = cfg.ldflags ? cfg.ldflags : BFUTILS_BUILD_LDFLAGS;
-        fprintf(bfutils_build_fp, " ldflags =");
-        for (int i = 0; i < cfg.deps_len; i++) {
-            char *val = bfutils_pkg_config_ldflags(cfg.deps[i]);
-            fprintf(bfutils_build_fp, " %s", val);
-            free(val);
+
+    // A static library has no link step, so its flags are passed to the targets that link it.
+    if (type == BFUTILS_BUILD_STATIC_LIBRARY) {
+        for (int i = 0; i < cfg.libs_len; i++) {
+            if (libs[i]->type == BFUTILS_BUILD_STATIC_LIBRARY) {
+                target.ldflags = bfutils_build_concat(target.ldflags, " ");
+                target.ldflags = bfutils_build_concat(target.ldflags, libs[i]->path);
+            }
+        }
+        if (ldflags) {
+            target.ldflags = bfutils_build_concat(target.ldflags, ldflags);
         }
-        fprintf(bfutils_build_fp, " %s\n", other_flags);
     }
-    else if (cfg.ldflags) {
-        fprintf(bfutils_build_fp, " ldflags = %s\n", cfg.ldflags);
+    else if (ldflags) {
+        fprintf(bfutils_build_fp, " ldflags =%s%s\n", ldflags, rpath);
     }
+    free(ldflags);
+    free(libs);
+
+    bfutils_build_targets = realloc(bfutils_build_targets, sizeof(BFUtilsBuildTarget) * (bfutils_build_targets_len + 1));
+    bfutils_build_targets[bfutils_build_targets_len++] = target;
+}
+
+void bfutils_add_static_library_fn(BFUtilsBuildCfg cfg, char *file, int line) {
+    bfutils_build_add_target(cfg, BFUTILS_BUILD_STATIC_LIBRARY, file, line);
+}
+
+void bfutils_add_shared_library_fn(BFUtilsBuildCfg cfg, char *file, int line) {
+    bfutils_build_add_target(cfg, BFUTILS_BUILD_SHARED_LIBRARY, file, line);
+}
+
+void bfutils_add_executable_fn(BFUtilsBuildCfg cfg, char *file, int line) {
+    bfutils_build_add_target(cfg, BFUTILS_BUILD_EXECUTABLE, file, line);
 }
 #endif //BFUTILS_BUILD_IMPLEMENTATION
@@ -0,0 +1,380 @@
+/* bfutils_deque.h
+
+DESCRIPTION:
+
+    This is a single-header-file library that provides double-ended queues (deque) and single-producer/single-consumer queues for C.
+    The deque is a growable ring buffer, so inserting and removing from both ends is O(1).
+
+USAGE:
+
+    In one source file put:
+        #define BFUTILS_DEQUE_IMPLEMENTATION
+        #include "bfutils_deque.h"
+
+    Other source files should contain only the import line.
+
+    Functions (macros):
+
+        deque:
+            T *deque(void (*)(void*)); Initializes a deque.
+            A deque doesn't needs to be initialized using this function, initializing with NULL will work fine.
+            This function is to be used when the internal elements of the deque needs to be free when freeing the deque.
+            The parameter is a function to free an element of the deque. The function will receive a pointer to the element as a "void*".
+
+        deque_header:
+            BFUtilsDequeHeader *deque_header(T*); Returns the header object.
+
+        deque_capacity:
+            size_t deque_capacity(T*); Returns the deque capacity. It is always a power of two.
+
+        deque_length:
+            size_t deque_length(T*); Returns the deque length.
+
+        deque_at:
+            T deque_at(T*, size_t); Returns the element at the provided index, where 0 is the front of the deque.
+            It can be used as an lvalue.
+
+        deque_front:
+            T deque_front(T*); Returns the first element of the deque.
+
+        deque_back:
+            T deque_back(T*); Returns the last element of the deque.
+
+        deque_push_back:
+            void deque_push_back(T*, T); Inserts an element at the end of the deque. Grows the deque if required.
+
+        deque_push_front:
+            void deque_push_front(T*, T); Inserts an element at the beginning of the deque. Grows the deque if required.
+
+        deque_pop_back:
+            T deque_pop_back(T*); Removes and returns the last element of the deque.
+
+        deque_pop_front:
+            T deque_pop_front(T*); Removes and returns the first element of the deque.
+
+        deque_drop_front:
+            void deque_drop_front(T*, size_t); Removes n elements from the beginning of the deque.
+            If an element_free function was provided during the deque initialization, it will be called for each removed element.
+
+        deque_iovec:
+            int deque_iovec(T*, struct iovec[2]); Fills the iovec array with the contiguous segments of the deque, in order.
+            Returns the number of segments (0, 1 or 2). The result can be passed directly to writev.
+
+        deque_clear:
+            void deque_clear(T*); Removes all elements of the deque, keeping its capacity.
+            If an element_free function was provided during the deque initialization, it will be called for each removed element.
+
+        deque_free:
+            void deque_free(T*); Frees the deque.
+            If an element_free function was provided during the deque initialization, this function will be called for each element of the deque, passing a pointer to the element.
+
+        spsc_queue:
+            T *spsc_queue(T, size_t); Creates a fixed-capacity lock-free queue of T, to be shared between one producer thread and one consumer thread.
+            The capacity is rounded up to a power of two.
+
+        spsc_header:
+            BFUtilsSpscHeader *spsc_header(T*); Returns the header object.
+
+        spsc_capacity:
+            size_t spsc_capacity(T*); Returns the queue capacity.
+
+        spsc_length:
+            size_t spsc_length(T*); Returns the number of elements in the queue.
+            If called while the other thread is using the queue, the value may be outdated.
+
+        spsc_push:
+            int spsc_push(T*, T); Inserts an element in the queue. It must only be called by the producer thread.
+            Returns a non-zero value on success, or 0 if the queue is full.
+
+        spsc_pop:
+            int spsc_pop(T*, T*); Removes the first element of the queue and copies it to the provided address. It must only be called by the consumer thread.
+            Returns a non-zero value on success, or 0 if the queue is empty.
+
+        spsc_free:
+            void spsc_free(T*); Frees the queue. No thread can be using the queue when it is called.
+
+    Compile-time options:
+
+        #define BFUTILS_DEQUE_NO_SHORT_NAME
+
+            This flag needs to be set globally.
+            By default this file exposes functions without bfutils_ prefix.
+            By defining this flag, this library will expose only functions prefixed with bfutils_
+
+        #define BFUTILS_DEQUE_REALLOC another_realloc
+        #define BFUTILS_DEQUE_FREE another_free
+
+            These flags needs to be set only in the file containing #define BFUTILS_DEQUE_IMPLEMENTATION
+            If you don't want to use 'stdlib.h' realloc and free function you can define this flag with a custom function.
+
+LICENSE:
+
+    MIT License
+
+    Copyright (c) 2024 Bruno Flávio Ferreira
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef BFUTILS_DEQUE_H
+#define BFUTILS_DEQUE_H
+
+#ifndef BFUTILS_DEQUE_NO_SHORT_NAME
+
+#define deque bfutils_deque
+#define deque_header bfutils_deque_header
+#define deque_capacity bfutils_deque_capacity
+#define deque_length bfutils_deque_length
+#define deque_at bfutils_deque_at
+#define deque_front bfutils_deque_front
+#define deque_back bfutils_deque_back
+#define deque_push_back bfutils_deque_push_back
+#define deque_push_front bfutils_deque_push_front
+#define deque_pop_back bfutils_deque_pop_back
+#define deque_pop_front bfutils_deque_pop_front
+#define deque_drop_front bfutils_deque_drop_front
+#define deque_iovec bfutils_deque_iovec
+#define deque_clear bfutils_deque_clear
+#define deque_free bfutils_deque_free
+#define spsc_queue bfutils_spsc_queue
+#define spsc_header bfutils_spsc_header
+#define spsc_capacity bfutils_spsc_capacity
+#define spsc_length bfutils_spsc_length
+#define spsc_push bfutils_spsc_push
+#define spsc_pop bfutils_spsc_pop
+#define spsc_free bfutils_spsc_free
+
+#endif //BFUTILS_DEQUE_NO_SHORT_NAME
+
+#if (!defined(BFUTILS_DEQUE_REALLOC) && defined(BFUTILS_DEQUE_FREE)) || (defined(BFUTILS_DEQUE_REALLOC) && !defined(BFUTILS_DEQUE_FREE))
+#error "You must define both BFUTILS_DEQUE_REALLOC and BFUTILS_DEQUE_FREE or neither."
+#endif
+
+#ifndef BFUTILS_DEQUE_REALLOC
+#include <stdlib.h>
+#define BFUTILS_DEQUE_REALLOC realloc
+#define BFUTILS_DEQUE_FREE free
+#endif //BFUTILS_DEQUE_REALLOC
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+typedef struct {
+    size_t head;
+    size_t length;
+    size_t capacity;
+    void (*element_free)(void*);
+} BFUtilsDequeHeader;
+
+// head and tail are kept 64 bytes apart so the producer and the consumer don't write to the same cache line.
+typedef struct {
+    atomic_size_t head;
+    char head_padding[64 - sizeof(atomic_size_t)];
+    atomic_size_t tail;
+    char tail_padding[64 - sizeof(atomic_size_t)];
+    size_t capacity;
+    char capacity_padding[64 - sizeof(size_t)];
+} BFUtilsSpscHeader;
+
+#define bfutils_deque_header(d) ((d) ? (BFUtilsDequeHeader *) (d) - 1 : NULL)
+#define bfutils_deque_capacity(d) ((d) ? bfutils_deque_header((d))->capacity : 0)
+#define bfutils_deque_element_free(d) ((d) ? bfutils_deque_header((d))->element_free : NULL)
+#define bfutils_deque_length(d) ((d) ? bfutils_deque_header((d))->length : 0)
+#define bfutils_deque_index(d, i) ((bfutils_deque_header((d))->head + (i)) & (bfutils_deque_header((d))->capacity - 1))
+#define bfutils_deque_at(d, i) ((d)[bfutils_deque_index((d), (i))])
+#define bfutils_deque_front(d) ((d)[bfutils_deque_header((d))->head])
+#define bfutils_deque_back(d) ((d)[bfutils_deque_index((d), bfutils_deque_header((d))->length - 1)])
+#define bfutils_deque_push_back(d, e) ((d) = bfutils_deque_grow((d), sizeof(*(d)), bfutils_deque_length((d)) + 1),\
+    (d)[bfutils_deque_index((d), bfutils_deque_header((d))->length++)] = (e))
+#define bfutils_deque_push_front(d, e) ((d) = bfutils_deque_grow((d), sizeof(*(d)), bfutils_deque_length((d)) + 1),\
+    (d)[bfutils_deque_push_front_position((d))] = (e))
+#define bfutils_deque_pop_back(d) ((d)[bfutils_deque_pop_back_position((d))])
+#define bfutils_deque_pop_front(d) ((d)[bfutils_deque_pop_front_position((d))])
+#define bfutils_deque_drop_front(d, n) (bfutils_deque_drop_front_f((d), sizeof(*(d)), (n)))
+#define bfutils_deque_iovec(d, iov) (bfutils_deque_iovec_f((d), sizeof(*(d)), (iov)))
+#define bfutils_deque_clear(d) (bfutils_deque_drop_front_f((d), sizeof(*(d)), bfutils_deque_length((d))))
+#define bfutils_deque_free(d) (bfutils_deque_free_f((d), sizeof(*(d))), (d) = NULL)
+#define bfutils_deque(element_free) (bfutils_deque_with_free((element_free)))
+
+#define bfutils_spsc_header(q) ((q) ? (BFUtilsSpscHeader *) (q) - 1 : NULL)
+#define bfutils_spsc_capacity(q) ((q) ? bfutils_spsc_header((q))->capacity : 0)
+#define bfutils_spsc_length(q) ((q) ? atomic_load(&bfutils_spsc_header((q))->tail) - atomic_load(&bfutils_spsc_header((q))->head) : 0)
+#define bfutils_spsc_queue(T, c) ((T*) bfutils_spsc_new(sizeof(T), (c)))
+#define bfutils_spsc_push(q, e) (bfutils_spsc_push_f((q), sizeof(*(q)), (typeof(*(q))[1]){e}))
+#define bfutils_spsc_pop(q, out) (bfutils_spsc_pop_f((q), sizeof(*(q)), (out)))
+#define bfutils_spsc_free(q) (bfutils_spsc_free_f((q)), (q) = NULL)
+
+extern void *bfutils_deque_with_free(void (*element_free)(void*));
+extern void *bfutils_deque_grow(void *deque, size_t element_size, size_t length);
+extern size_t bfutils_deque_push_front_position(void *deque);
+extern size_t bfutils_deque_pop_front_position(void *deque);
+extern size_t bfutils_deque_pop_back_position(void *deque);
+extern void bfutils_deque_drop_front_f(void *deque, size_t element_size, size_t n);
+extern int bfutils_deque_iovec_f(void *deque, size_t element_size, struct iovec *iov);
+extern void bfutils_deque_free_f(void *deque, size_t element_size);
+
+extern void *bfutils_spsc_new(size_t element_size, size_t capacity);
+extern int bfutils_spsc_push_f(void *queue, size_t element_size, const void *element);
+extern int bfutils_spsc_pop_f(void *queue, size_t element_size, void *out);
+extern void bfutils_spsc_free_f(void *queue);
+
+#endif // BFUTILS_DEQUE_H
+#ifdef BFUTILS_DEQUE_IMPLEMENTATION
+#include <string.h>
+
+void *bfutils_deque_with_free(void (*element_free) (void*)) {
+    BFUtilsDequeHeader *header = BFUTILS_DEQUE_REALLOC(NULL, sizeof(BFUtilsDequeHeader));
+    header->head = 0;
+    header->capacity = 0;
+    header->length = 0;
+    header->element_free = element_free;
+    return (void*)(header + 1);
+}
+
+void *bfutils_deque_grow(void *deque, size_t element_size, size_t length) {
+    size_t old_capacity = bfutils_deque_capacity(deque);
+    if (old_capacity >= length) {
+        return deque;
+    }
+    size_t capacity = old_capacity > 0 ? old_capacity * 2 : 128;
+    while (capacity < length) {
+        capacity *= 2;
+    }
+    size_t head = deque ? bfutils_deque_header(deque)->head : 0;
+    size_t current_length = bfutils_deque_length(deque);
+    void (*element_free)(void*) = bfutils_deque_element_free(deque);
+    BFUtilsDequeHeader *header = BFUTILS_DEQUE_REALLOC(bfutils_deque_header(deque), sizeof(BFUtilsDequeHeader) + (element_size * capacity));
+    unsigned char *data = (unsigned char*)(header + 1);
+
+    // If the elements wrap around the end of the old buffer, moves the first segment to the end of the new one.
+    if (head + current_length > old_capacity) {
+        size_t first_segment = old_capacity - head;
+        size_t new_head = capacity - first_segment;
+        memmove(data + (element_size * new_head), data + (element_size * head), element_size * first_segment);
+        head = new_head;
+    }
+    header->head = head;
+    header->capacity = capacity;
+    header->length = current_length;
+    header->element_free = element_free;
+    return (void*) data;
+}
+
+size_t bfutils_deque_push_front_position(void *deque) {
+    BFUtilsDequeHeader *header = bfutils_deque_header(deque);
+    header->head = (header->head - 1) & (header->capacity - 1);
+    header->length++;
+    return header->head;
+}
+
+size_t bfutils_deque_pop_front_position(void *deque) {
+    BFUtilsDequeHeader *header = bfutils_deque_header(deque);
+    size_t pos = header->head;
+    header->head = (header->head + 1) & (header->capacity - 1);
+    header->length--;
+    return pos;
+}
+
+size_t bfutils_deque_pop_back_position(void *deque) {
+    BFUtilsDequeHeader *header = bfutils_deque_header(deque);
+    header->length--;
+    return (header->head + header->length) & (header->capacity - 1);
+}
+
+void bfutils_deque_drop_front_f(void *deque, size_t element_size, size_t n) {
+    if (deque == NULL) return;
+    BFUtilsDequeHeader *header = bfutils_deque_header(deque);
+    if (n > header->length) n = header->length;
+
+    if (header->element_free != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            header->element_free((unsigned char*) deque + (element_size * bfutils_deque_index(deque, i)));
+        }
+    }
+    header->head = header->length == n ? 0 : (header->head + n) & (header->capacity - 1);
+    header->length -= n;
+}
+
+int bfutils_deque_iovec_f(void *deque, size_t element_size, struct iovec *iov) {
+    if (bfutils_deque_length(deque) == 0) return 0;
+    BFUtilsDequeHeader *header = bfutils_deque_header(deque);
+    unsigned char *data = (unsigned char*) deque;
+    size_t first_segment = header->capacity - header->head;
+    if (first_segment >= header->length) {
+        iov[0].iov_base = data + (element_size * header->head);
+        iov[0].iov_len = element_size * header->length;
+        return 1;
+    }
+    iov[0].iov_base = data + (element_size * header->head);
+    iov[0].iov_len = element_size * first_segment;
+    iov[1].iov_base = data;
+    iov[1].iov_len = element_size * (header->length - first_segment);
+    return 2;
+}
+
+void bfutils_deque_free_f(void *deque, size_t element_size) {
+    if (deque == NULL) return;
+    bfutils_deque_drop_front_f(deque, element_size, bfutils_deque_length(deque));
+    BFUTILS_DEQUE_FREE(bfutils_deque_header(deque));
+}
+
+void *bfutils_spsc_new(size_t element_size, size_t capacity) {
+    size_t c = 1;
+    while (c < capacity) {
+        c *= 2;
+    }
+    BFUtilsSpscHeader *header = BFUTILS_DEQUE_REALLOC(NULL, sizeof(BFUtilsSpscHeader) + (element_size * c));
+    atomic_init(&header->head, 0);
+    atomic_init(&header->tail, 0);
+    header->capacity = c;
+    return (void*)(header + 1);
+}
+
+// head and tail only grow, the slot of an index is obtained by masking it with capacity - 1.
+int bfutils_spsc_push_f(void *queue, size_t element_size, const void *element) {
+    BFUtilsSpscHeader *header = bfutils_spsc_header(queue);
+    size_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+    if (tail - head == header->capacity) {
+        return 0;
+    }
+    memcpy((unsigned char*) queue + (element_size * (tail & (header->capacity - 1))), element, element_size);
+    atomic_store_explicit(&header->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+int bfutils_spsc_pop_f(void *queue, size_t element_size, void *out) {
+    BFUtilsSpscHeader *header = bfutils_spsc_header(queue);
+    size_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+    memcpy(out, (unsigned char*) queue + (element_size * (head & (header->capacity - 1))), element_size);
+    atomic_store_explicit(&header->head, head + 1, memory_order_release);
+    return 1;
+}
+
+void bfutils_spsc_free_f(void *queue) {
+    if (queue == NULL) return;
+    BFUTILS_DEQUE_FREE(bfutils_spsc_header(queue));
+}
+#endif //BFUTILS_DEQUE_IMPLEMENTATION
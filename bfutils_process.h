@@ -22,14 +22,129 @@ USAGE:
             The caller needs to free *out and *err.
             The return value is the process exit status.
         
+        process_sync_n:
+        int process_sync_n(char *const *cmd, const char *in, size_t in_len, char **out, size_t *out_len, char **err, size_t *err_len);
+            Same as process_sync, but the input and the outputs have explicit lengths, so they can contain binary data (including \0 bytes).
+            if "out_len" or "err_len" is not NULL, the number of bytes of *out or *err will be placed on them.
+
         process_async:
         Process process_async(char *const *cmd); Starts a new process and return imediatelly.
             "cmd" needs to be a null-terminated array containing the process and its arguments.
-            It returns a handle to the process.
+            It returns a handle to the process. If the process could not be started, its pid is -1.
+            The file descriptors on the handle are non-blocking.
             The caller needs to call process_close to close all opened file descriptors.
 
+        process_async_with:
+        Process process_async_with(...); Same as process_async, but the arguments are ProcessOptions fields, e.g.:
+            process_async_with(.cmd = cmd, .in = process_redirect_file("input.bin"), .err = process_redirect_null());
+            The "cmd" field is the null-terminated command. The "in", "out" and "err" fields choose where the process stdin, stdout and stderr are connected:
+                (default): a pipe, available on the returned handle.
+                process_redirect_fd(fd): a copy of an existing file descriptor. The caller still owns fd.
+                process_redirect_file(path): the file at path, opened for reading (stdin) or created/truncated for writing (stdout and stderr).
+                process_redirect_null(): /dev/null.
+                process_redirect_inherit(): the same stream of the calling process.
+            The handle fields of redirected streams are -1. A file redirected to stdin is read by the child directly, without passing through the caller.
+            The "limits" field is an array of limits_len ProcessLimit {resource, value}, set as both the soft and hard limit (see setrlimit) before the command runs, e.g.:
+                .limits = (ProcessLimit[]){{RLIMIT_CPU, 10}, {RLIMIT_AS, 1 << 30}}, .limits_len = 2
+            A process with limits is started with fork instead of posix_spawn.
+
+        process_send_file:
+        int process_send_file(Process *p, int fd);
+            It writes the contents of fd, from its current offset to the end, to the process stdin. On Linux it uses sendfile, so the data is not copied to user space.
+            It blocks until everything is written, so the process outputs need to be redirected or consumed by another thread.
+            It returns 0 on success or -1 on error.
+
+        process_communicate:
+        int process_communicate(Process *p, const char *in, size_t in_len, ProcessOutputCallback on_stdout, ProcessOutputCallback on_stderr, void *user_data);
+            It writes in_len bytes of "in" to the process stdin while reading its stdout and stderr, using poll, until both are closed.
+            The stdin is closed after all the input is written, so the process receives EOF.
+            Each chunk read is passed to on_stdout or on_stderr as soon as it arrives, together with user_data.
+            If a callback is NULL, the data from that stream is read and discarded, so the process never blocks on a full pipe.
+            It returns 0 on success or -1 on error. It doesn't wait for the process; call process_wait afterwards.
+
+        process_pool_run:
+        int process_pool_run(ProcessJob *jobs, size_t jobs_len, int max_running, ProcessJobCallback on_complete, void *user_data);
+            It runs all the jobs, keeping at most max_running processes at the same time. If max_running is 0 or less, the number of CPUs is used.
+            For each job, "cmd" is the null-terminated command and, if "in" is not NULL, in_len bytes of it are sent to the process stdin.
+            The pipes of all running processes are handled by a single poll loop.
+            When a job finishes, its "status", "out", "out_len", "err" and "err_len" fields are filled and on_complete (if not NULL) is called with the job and user_data.
+            "status" is -1 if the process could not be started. "out" and "err" are null-terminated and the caller needs to free them.
+            It returns 0 on success or -1 on error. On error, the jobs still running are killed and their "status" is set to -1.
+
+        process_pipeline:
+        ProcessPipeline process_pipeline(char *const *const *cmds, size_t cmds_len);
+            Starts cmds_len processes, connecting the stdout of each one directly to the stdin of the next, like "cmd1 | cmd2 | cmd3" in a shell.
+            The data between the stages goes through the pipes only, it's never copied to the caller memory.
+            The "process" field is a handle whose stdin is the first stage stdin, stdout is the last stage stdout and stderr is shared by all stages,
+            so it can be used with process_communicate, process_write_stdin and the process_read_* functions.
+            "pids" contains the pid of each stage. If any stage could not be started, "length" is 0 and process.pid is -1.
+            The caller needs to call process_pipeline_close to close the file descriptors.
+
+        process_pipeline_wait:
+        int process_pipeline_wait(ProcessPipeline *pipeline, int *statuses);
+            It closes the pipeline stdin and waits for all the stages. If "statuses" is not NULL, the exit status of each stage is placed on it.
+            It returns the status of the last stage that failed, or 0 if all of them succeeded.
+
+        process_pipeline_close:
+        void process_pipeline_close(ProcessPipeline *pipeline); It closes all opened file descriptors and frees the pids.
+
+        process_worker_start:
+        int process_worker_start(ProcessWorker *w, char *const *cmd);
+            Starts a persistent worker process, which receives requests on its stdin and answers each one on its stdout, so a process is not started per request.
+            Requests and responses are frames: a 4-byte length in network byte order (big-endian) followed by that many bytes.
+            The worker stderr goes to the caller stderr. "cmd" needs to stay valid while the worker is used, because it's used to restart it.
+            It returns 0 on success or -1 on error. The caller needs to call process_worker_stop.
+
+        process_worker_call:
+        int process_worker_call(ProcessWorker *w, const char *request, size_t request_len, char **response, size_t *response_len);
+            It sends the request frame while reading the response frame. *response points to a null-terminated buffer owned by the worker, valid until the next response.
+            If the worker exited before receiving any of the request, it's restarted and the request is sent again.
+            If it exits after that, before answering, it's restarted and -1 is returned, since the request may have been processed.
+            "restarts" counts how many times the worker was restarted. It returns 0 on success or -1 on error.
+            If request_len doesn't fit in 32 bits or the worker was stopped, it returns -1 with errno set to EINVAL without restarting the worker.
+            If a restart failed, the next call tries to restart the worker again.
+
+        process_worker_send:
+        process_worker_receive:
+        int process_worker_send(ProcessWorker *w, const char *request, size_t request_len);
+        int process_worker_receive(ProcessWorker *w, char **response, size_t *response_len);
+            The two halves of process_worker_call, without the restarts. They allow sending requests to several workers before waiting for the responses.
+            process_worker_send blocks until the whole frame is written, so frames larger than the pipe buffer need a worker that reads the whole request before answering.
+
+        process_worker_restart:
+        int process_worker_restart(ProcessWorker *w); It kills the worker (if it's running) and starts a new one.
+
+        process_worker_stop:
+        void process_worker_stop(ProcessWorker *w); It closes the worker stdin, waits for it to exit and frees its resources.
+
+        process_worker_pool_start:
+        int process_worker_pool_start(ProcessWorkerPool *pool, char *const *cmd, size_t length); Starts "length" workers running cmd.
+            It returns -1 with errno set to EINVAL if length is 0.
+
+        process_worker_pool_next:
+        ProcessWorker *process_worker_pool_next(ProcessWorkerPool *pool); It returns the workers of the pool in turn (round-robin).
+            It returns NULL, with errno set to EINVAL, if the pool has no workers.
+
+        process_worker_pool_call:
+        int process_worker_pool_call(ProcessWorkerPool *pool, const char *request, size_t request_len, char **response, size_t *response_len);
+            Same as process_worker_call, using the next worker of the pool.
+
+        process_worker_pool_stop:
+        void process_worker_pool_stop(ProcessWorkerPool *pool); Stops all the workers and frees the pool.
+
         process_write_stdin:
         void process_write_stdin(Process *p, const char *in); It writes the contents of in to the process stdin.
+            It blocks until the whole string is written, so the process outputs need to be redirected or consumed by another thread.
+
+        process_write_stdin_n:
+        ssize_t process_write_stdin_n(Process *p, const char *data, size_t length);
+            It writes as many of the "length" bytes of data as fit in the stdin pipe, without blocking. The data can contain \0 bytes.
+            It returns the number of bytes written, 0 if the pipe is full, or -1 on error (e.g. EPIPE if the process closed its stdin).
+            To stream a large input, poll p->stdin_fd for POLLOUT (together with the outputs) and call it again with the remaining data.
+
+        process_writev_stdin:
+        ssize_t process_writev_stdin(Process *p, const struct iovec *iov, int iovcnt);
+            Same as process_write_stdin_n, but it writes the iovcnt buffers in iov, in order, with a single writev call.
 
         process_read_stdout:
         char *process_read_stdout(Process *p); It returns the contents of the process stdout as a null-terminated string.
@@ -39,8 +154,45 @@ USAGE:
         char *process_read_stderr(Process *p); It returns the contents of the process stderr as a null-terminated string.
             The caller needs to free the returned string.
 
+        process_read_stdout_n:
+        char *process_read_stdout_n(Process *p, size_t *length); Same as process_read_stdout, but the number of bytes read is placed at *length.
+            Use it when the output can contain \0 bytes.
+
+        process_read_stderr_n:
+        char *process_read_stderr_n(Process *p, size_t *length); Same as process_read_stderr, but the number of bytes read is placed at *length.
+
+        process_read_stdout_vector:
+        void process_read_stdout_vector(Process *p, char *v); Appends the contents of the process stdout to the char* vector v.
+            It is only available when bfutils_vector.h is included before bfutils_process.h.
+
+        process_read_stderr_vector:
+        void process_read_stderr_vector(Process *p, char *v); Appends the contents of the process stderr to the char* vector v.
+            It is only available when bfutils_vector.h is included before bfutils_process.h.
+
         process_wait:
         int process_wait(Process *p); It waits for the end of the process execution and returns its exit status.
+            After the process is reaped, its pid is set to -1, so the same process is never waited for or killed again.
+            The same applies to process_wait_timeout and to process_is_running when it returns 0.
+
+        process_wait_timeout:
+        int process_wait_timeout(Process *p, int timeout, ProcessUsage *usage);
+            Same as process_wait, but if the process is still running "timeout" milliseconds after this call (never if timeout is negative), it receives SIGTERM,
+            and SIGKILL if it doesn't exit within BFUTILS_PROCESS_KILL_GRACE_MS milliseconds more.
+            If usage is not NULL, the resources used by the process are placed on it: "user_time" and "system_time" (CPU seconds),
+            "wall_time" (seconds since the process started), "max_rss" (maximum resident set size in kilobytes) and "timed_out" (non-zero if it was killed by the timeout).
+
+        process_wait_any:
+        long process_wait_any(Process *processes, size_t length, int timeout, int *status);
+            It waits until any of the processes exits, for at most "timeout" milliseconds (or forever if timeout is negative).
+            It returns the index of the process that exited, placing its exit status at *status (if not NULL), and sets its pid to -1 so it's skipped by the next calls.
+            It returns -1 on timeout (errno is ETIMEDOUT), if there are no processes left to wait (errno is ECHILD) or on error.
+            On Linux, each process is watched through a pidfd, so it sleeps in the kernel instead of polling. On kernels without pidfd_open,
+            SIGCHLD is blocked in the calling thread while it waits and received through a signalfd; the signal mask is restored before it returns.
+
+        process_pidfd:
+        int process_pidfd(Process *p);
+            It returns a file descriptor that becomes readable (POLLIN) when the process exits, so it can be polled together with the process pipes.
+            After it's readable, process_wait returns immediately. It returns -1 if pidfds are not supported. The descriptor is closed by process_close.
         
         process_is_running:
         int process_is_running(Process *p, int *status); It returns a non-zero value if process is running.
@@ -66,6 +218,15 @@ USAGE:
             These flags needs to be set only in the file containing #define BFUTILS_PROCESS_IMPLEMENTATION
             If you don't want to use 'stdlib.h' memory functions you can define these flags with custom functions.
 
+        #define BFUTILS_PROCESS_KILL_GRACE_MS 2000
+
+            The time, in milliseconds, process_wait_timeout waits between sending SIGTERM and SIGKILL.
+
+        #define BFUTILS_PROCESS_USE_FORK
+
+            Processes are started with posix_spawn, which doesn't copy the parent memory, so starting a process is fast even from a parent with a large heap.
+            By defining this flag (in the file containing #define BFUTILS_PROCESS_IMPLEMENTATION), fork and execvp are used instead.
+
 LICENSE:
 
     MIT License
@@ -96,26 +257,147 @@ LICENSE:
 #define BFUTILS_PROCESS_H
 
 #include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
 
 typedef struct {
     pid_t pid;
     int stdin_fd;
     int stdout_fd;
     int stderr_fd;
+    struct timespec start_time;
+    // pid_fd is only valid when pid_fd_owned is set, so a zero-initialized process never closes descriptor 0.
+    int pid_fd;
+    int pid_fd_owned;
 } BFUtilsProcess;
 
+typedef struct {
+    double user_time;
+    double system_time;
+    double wall_time;
+    long max_rss;
+    int timed_out;
+} BFUtilsProcessUsage;
+
+typedef struct {
+    int resource;
+    rlim_t value;
+} BFUtilsProcessLimit;
+
+typedef enum {
+    BFUTILS_PROCESS_REDIRECT_PIPE = 0,
+    BFUTILS_PROCESS_REDIRECT_FD,
+    BFUTILS_PROCESS_REDIRECT_FILE,
+    BFUTILS_PROCESS_REDIRECT_INHERIT,
+} BFUtilsProcessRedirectType;
+
+typedef struct {
+    BFUtilsProcessRedirectType type;
+    int fd;
+    const char *path;
+} BFUtilsProcessRedirect;
+
+typedef struct {
+    char *const *cmd;
+    BFUtilsProcessRedirect in;
+    BFUtilsProcessRedirect out;
+    BFUtilsProcessRedirect err;
+    const BFUtilsProcessLimit *limits;
+    size_t limits_len;
+} BFUtilsProcessOptions;
+
+typedef void (*BFUtilsProcessOutputCallback)(const char *data, size_t length, void *user_data);
+
+typedef struct {
+    char *const *cmd;
+    const char *in;
+    size_t in_len;
+    int status;
+    char *out;
+    size_t out_len;
+    char *err;
+    size_t err_len;
+} BFUtilsProcessJob;
+
+typedef void (*BFUtilsProcessJobCallback)(BFUtilsProcessJob *job, void *user_data);
+
+typedef struct {
+    BFUtilsProcess process;
+    pid_t *pids;
+    size_t length;
+} BFUtilsProcessPipeline;
+
+typedef struct {
+    char *const *cmd;
+    BFUtilsProcess process;
+    char *buffer;
+    size_t buffer_capacity;
+    int restarts;
+    int stopped;
+} BFUtilsProcessWorker;
+
+typedef struct {
+    BFUtilsProcessWorker *workers;
+    size_t length;
+    size_t next;
+} BFUtilsProcessWorkerPool;
+
 #ifndef BFUTILS_PROCESS_NO_SHORT_NAME
 
 #define process_sync bfutils_process_sync
 #define process_async bfutils_process_async
+#define process_async_with bfutils_process_async_with
+#define process_redirect_fd bfutils_process_redirect_fd
+#define process_redirect_file bfutils_process_redirect_file
+#define process_redirect_null bfutils_process_redirect_null
+#define process_redirect_inherit bfutils_process_redirect_inherit
+#define process_send_file bfutils_process_send_file
+#define process_communicate bfutils_process_communicate
+#define process_pool_run bfutils_process_pool_run
+#define process_pipeline bfutils_process_pipeline
+#define process_pipeline_wait bfutils_process_pipeline_wait
+#define process_pipeline_close bfutils_process_pipeline_close
+#define process_worker_start bfutils_process_worker_start
+#define process_worker_restart bfutils_process_worker_restart
+#define process_worker_send bfutils_process_worker_send
+#define process_worker_receive bfutils_process_worker_receive
+#define process_worker_call bfutils_process_worker_call
+#define process_worker_stop bfutils_process_worker_stop
+#define process_worker_pool_start bfutils_process_worker_pool_start
+#define process_worker_pool_next bfutils_process_worker_pool_next
+#define process_worker_pool_call bfutils_process_worker_pool_call
+#define process_worker_pool_stop bfutils_process_worker_pool_stop
 #define process_write_stdin bfutils_process_write_stdin
+#define process_write_stdin_n bfutils_process_write_stdin_n
+#define process_writev_stdin bfutils_process_writev_stdin
 #define process_read_stdout bfutils_process_read_stdout
 #define process_read_stderr bfutils_process_read_stderr
+#define process_sync_n bfutils_process_sync_n
+#define process_read_stdout_n bfutils_process_read_stdout_n
+#define process_read_stderr_n bfutils_process_read_stderr_n
+#define process_read_stdout_vector bfutils_process_read_stdout_vector
+#define process_read_stderr_vector bfutils_process_read_stderr_vector
 #define process_wait bfutils_process_wait
+#define process_wait_timeout bfutils_process_wait_timeout
+#define process_wait_any bfutils_process_wait_any
+#define process_pidfd bfutils_process_pidfd
 #define process_is_running bfutils_process_is_running
 #define process_close bfutils_process_close
 
 typedef BFUtilsProcess Process;
+typedef BFUtilsProcessRedirect ProcessRedirect;
+typedef BFUtilsProcessOptions ProcessOptions;
+typedef BFUtilsProcessUsage ProcessUsage;
+typedef BFUtilsProcessLimit ProcessLimit;
+typedef BFUtilsProcessOutputCallback ProcessOutputCallback;
+typedef BFUtilsProcessJob ProcessJob;
+typedef BFUtilsProcessJobCallback ProcessJobCallback;
+typedef BFUtilsProcessPipeline ProcessPipeline;
+typedef BFUtilsProcessWorker ProcessWorker;
+typedef BFUtilsProcessWorkerPool ProcessWorkerPool;
 
 #endif //BFUTILS_PROCESS_NO_SHORT_NAME
 
@@ -136,10 +418,46 @@ typedef BFUtilsProcess Process;
 
 extern int bfutils_process_sync(char *const *cmd, const char *in, char **out, char **err);
 extern BFUtilsProcess bfutils_process_async(char *const *cmd);
+#define bfutils_process_async_with(...) bfutils_process_async_fn((BFUtilsProcessOptions){__VA_ARGS__})
+#define bfutils_process_redirect_fd(f) ((BFUtilsProcessRedirect){.type = BFUTILS_PROCESS_REDIRECT_FD, .fd = (f)})
+#define bfutils_process_redirect_file(p) ((BFUtilsProcessRedirect){.type = BFUTILS_PROCESS_REDIRECT_FILE, .path = (p)})
+#define bfutils_process_redirect_null() bfutils_process_redirect_file("/dev/null")
+#define bfutils_process_redirect_inherit() ((BFUtilsProcessRedirect){.type = BFUTILS_PROCESS_REDIRECT_INHERIT})
+extern BFUtilsProcess bfutils_process_async_fn(BFUtilsProcessOptions options);
+extern int bfutils_process_send_file(BFUtilsProcess *p, int fd);
+extern int bfutils_process_communicate(BFUtilsProcess *p, const char *in, size_t in_len, BFUtilsProcessOutputCallback on_stdout, BFUtilsProcessOutputCallback on_stderr, void *user_data);
+extern int bfutils_process_pool_run(BFUtilsProcessJob *jobs, size_t jobs_len, int max_running, BFUtilsProcessJobCallback on_complete, void *user_data);
+extern BFUtilsProcessPipeline bfutils_process_pipeline(char *const *const *cmds, size_t cmds_len);
+extern int bfutils_process_pipeline_wait(BFUtilsProcessPipeline *pipeline, int *statuses);
+extern void bfutils_process_pipeline_close(BFUtilsProcessPipeline *pipeline);
+extern int bfutils_process_worker_start(BFUtilsProcessWorker *w, char *const *cmd);
+extern int bfutils_process_worker_restart(BFUtilsProcessWorker *w);
+extern int bfutils_process_worker_send(BFUtilsProcessWorker *w, const char *request, size_t request_len);
+extern int bfutils_process_worker_receive(BFUtilsProcessWorker *w, char **response, size_t *response_len);
+extern int bfutils_process_worker_call(BFUtilsProcessWorker *w, const char *request, size_t request_len, char **response, size_t *response_len);
+extern void bfutils_process_worker_stop(BFUtilsProcessWorker *w);
+extern int bfutils_process_worker_pool_start(BFUtilsProcessWorkerPool *pool, char *const *cmd, size_t length);
+extern BFUtilsProcessWorker *bfutils_process_worker_pool_next(BFUtilsProcessWorkerPool *pool);
+extern int bfutils_process_worker_pool_call(BFUtilsProcessWorkerPool *pool, const char *request, size_t request_len, char **response, size_t *response_len);
+extern void bfutils_process_worker_pool_stop(BFUtilsProcessWorkerPool *pool);
 extern void bfutils_process_write_stdin(BFUtilsProcess *p, const char *in);
+extern ssize_t bfutils_process_write_stdin_n(BFUtilsProcess *p, const char *data, size_t length);
+extern ssize_t bfutils_process_writev_stdin(BFUtilsProcess *p, const struct iovec *iov, int iovcnt);
 extern char *bfutils_process_read_stdout(BFUtilsProcess *p);
 extern char *bfutils_process_read_stderr(BFUtilsProcess *p);
+extern int bfutils_process_sync_n(char *const *cmd, const char *in, size_t in_len, char **out, size_t *out_len, char **err, size_t *err_len);
+extern char *bfutils_process_read_stdout_n(BFUtilsProcess *p, size_t *length);
+extern char *bfutils_process_read_stderr_n(BFUtilsProcess *p, size_t *length);
+
+#ifdef BFUTILS_VECTOR_H
+#define bfutils_process_read_stdout_vector(p, v) ((v) = bfutils_process_read_fd_vector((p)->stdout_fd, (v)))
+#define bfutils_process_read_stderr_vector(p, v) ((v) = bfutils_process_read_fd_vector((p)->stderr_fd, (v)))
+extern char *bfutils_process_read_fd_vector(int fd, char *vector);
+#endif //BFUTILS_VECTOR_H
 extern int bfutils_process_wait(BFUtilsProcess *p);
+extern int bfutils_process_wait_timeout(BFUtilsProcess *p, int timeout, BFUtilsProcessUsage *usage);
+extern long bfutils_process_wait_any(BFUtilsProcess *processes, size_t length, int timeout, int *status);
+extern int bfutils_process_pidfd(BFUtilsProcess *p);
 extern int bfutils_process_is_running(BFUtilsProcess *p, int *status);
 extern void bfutils_process_close(BFUtilsProcess *p);
 
@@ -150,23 +468,76 @@ extern void bfutils_process_close(BFUtilsProcess *p);
 #include <string.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#ifdef SYS_pidfd_open
+#define BFUTILS_PROCESS_HAS_PIDFD
+#endif //SYS_pidfd_open
+#endif //__linux__
+#ifndef BFUTILS_PROCESS_USE_FORK
+#include <spawn.h>
+#endif //BFUTILS_PROCESS_USE_FORK
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} BFUtilsProcessBuffer;
 
-void read_fd(int fd, char **res) {
-    char buffer[1024];
-    int count = 0;
-    int length; 
-    *res = NULL;
-    do {
-        length = read(fd, buffer, 1024);
-        if (length < 0){
-            length = 0;
+// Ensures there is space for n more bytes and a \0, doubling the capacity as needed.
+static void bfutils_process_buffer_reserve(BFUtilsProcessBuffer *buffer, size_t n) {
+    if (buffer->length + n + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 4096;
+        while (capacity < buffer->length + n + 1) {
+            capacity *= 2;
         }
-        *res = (char*) BFUTILS_PROCESS_REALLOC(*res, count + length + 1);
-        if (length > 0)
-            strncpy(*res + count, buffer, length);
-        count += length;
-    } while(length > 0);
-    (*res)[count] = '\0';
+        buffer->data = (char*) BFUTILS_PROCESS_REALLOC(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+}
+
+static void bfutils_process_buffer_append(const char *data, size_t length, void *user_data) {
+    BFUtilsProcessBuffer *buffer = (BFUtilsProcessBuffer*) user_data;
+    bfutils_process_buffer_reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+#define BFUTILS_PROCESS_READ_SIZE 65536
+
+#ifndef BFUTILS_PROCESS_KILL_GRACE_MS
+#define BFUTILS_PROCESS_KILL_GRACE_MS 2000
+#endif //BFUTILS_PROCESS_KILL_GRACE_MS
+
+// Reads everything currently available on fd directly into the buffer, stopping at EOF or when the read would block.
+static void bfutils_process_buffer_read(BFUtilsProcessBuffer *buffer, int fd) {
+    while (1) {
+        bfutils_process_buffer_reserve(buffer, BFUTILS_PROCESS_READ_SIZE);
+        ssize_t n = read(fd, buffer->data + buffer->length, buffer->capacity - buffer->length - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        buffer->length += n;
+    }
+    buffer->data[buffer->length] = '\0';
+}
+
+size_t read_fd(int fd, char **res) {
+    BFUtilsProcessBuffer buffer = {0};
+    bfutils_process_buffer_read(&buffer, fd);
+    *res = buffer.data;
+    return buffer.length;
 }
 
 void close_pair(int *fd) {
@@ -174,118 +545,998 @@ void close_pair(int *fd) {
     close(fd[1]);
 }
 
+static int bfutils_process_set_nonblock(int fd) {
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != -1;
+}
+
 int set_fds_nonblock(int *stdout_fd, int *stderr_fd){
-    if (fcntl(stdout_fd[0], F_SETFL, fcntl(stdout_fd[0], F_GETFL) | O_NONBLOCK) == -1){
-        return 0;
+    // Only the ends used by the parent are non-blocking, the child gets normal blocking pipes.
+    return bfutils_process_set_nonblock(stdout_fd[0]) && bfutils_process_set_nonblock(stderr_fd[0]);
+}
+
+// A child that exits without reading all its input would kill the parent with SIGPIPE, so it's blocked while writing to stdin.
+static void bfutils_process_block_sigpipe(sigset_t *old_mask) {
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &sigpipe, old_mask);
+}
+
+// Discards a SIGPIPE raised while it was blocked and restores the previous mask.
+static void bfutils_process_restore_sigpipe(const sigset_t *old_mask) {
+    sigset_t pending;
+    sigpending(&pending);
+    if (sigismember(&pending, SIGPIPE) && !sigismember(old_mask, SIGPIPE)) {
+        sigset_t sigpipe;
+        sigemptyset(&sigpipe);
+        sigaddset(&sigpipe, SIGPIPE);
+        struct timespec zero = {0};
+        sigtimedwait(&sigpipe, NULL, &zero);
     }
-    if (fcntl(stdout_fd[1], F_SETFL, fcntl(stdout_fd[1], F_GETFL) | O_NONBLOCK) == -1){
-        return 0;
+    sigprocmask(SIG_SETMASK, old_mask, NULL);
+}
+
+static int bfutils_process_exit_status(int status) {
+    if (status == -1) {
+        return -1;
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    else if (WIFSIGNALED(status)) {
+        return WTERMSIG(status);
+    }
+    else if (WIFSTOPPED(status)) {
+        return WSTOPSIG(status);
     }
-    if (fcntl(stderr_fd[0], F_SETFL, fcntl(stderr_fd[0], F_GETFL) | O_NONBLOCK) == -1){
+    return status;
+}
+
+// The pipes are close-on-exec, so processes started at the same time (e.g. by process_pool_run) don't inherit each other's ends.
+static int bfutils_process_pipe(int *fd) {
+    if (pipe(fd) < 0) {
         return 0;
     }
-    if (fcntl(stderr_fd[1], F_SETFL, fcntl(stderr_fd[1], F_GETFL) | O_NONBLOCK) == -1){
+    if (fcntl(fd[0], F_SETFD, FD_CLOEXEC) == -1 || fcntl(fd[1], F_SETFD, FD_CLOEXEC) == -1) {
+        close_pair(fd);
         return 0;
     }
     return 1;
 }
 
-BFUtilsProcess bfutils_process_async(char *const *cmd) {
-    BFUtilsProcess process = {.pid = -1, .stdin_fd = -1, .stdout_fd = -1, .stderr_fd = -1};
-    if(cmd == NULL || *cmd == NULL) {
-        return process;
+// If exec fails, the child sends errno through a close-on-exec pipe, so the parent reports the failure like posix_spawn does.
+static pid_t bfutils_process_fork(char *const *cmd, int stdin_fd, int stdout_fd, int stderr_fd, const BFUtilsProcessLimit *limits, size_t limits_len) {
+    int error_fd[2];
+    if (!bfutils_process_pipe(error_fd)) {
+        return -1;
     }
-    int stdin_fd[2];
-    int stdout_fd[2];
-    int stderr_fd[2];
+    pid_t pid = fork();
+    if (pid == 0) {
+        int ok = dup2(stdin_fd, STDIN_FILENO) >= 0 && dup2(stdout_fd, STDOUT_FILENO) >= 0 && dup2(stderr_fd, STDERR_FILENO) >= 0;
+        for (size_t i = 0; ok && i < limits_len; i++) {
+            struct rlimit limit = {.rlim_cur = limits[i].value, .rlim_max = limits[i].value};
+            ok = setrlimit(limits[i].resource, &limit) == 0;
+        }
+        if (ok) {
+            execvp(cmd[0], cmd);
+        }
+        int error = errno;
+        if (write(error_fd[1], &error, sizeof(error)) < 0) {
+            _exit(126);
+        }
+        _exit(127);
+    }
+    close(error_fd[1]);
+    if (pid > 0) {
+        int error;
+        ssize_t n;
+        while ((n = read(error_fd[0], &error, sizeof(error))) < 0 && errno == EINTR);
+        if (n == sizeof(error)) {
+            waitpid(pid, NULL, 0);
+            errno = error;
+            pid = -1;
+        }
+    }
+    close(error_fd[0]);
+    return pid;
+}
 
-    if (pipe(stdin_fd) < 0) {
-        return process;
+#ifndef BFUTILS_PROCESS_USE_FORK
+extern char **environ;
+
+// posix_spawn is implemented with vfork or clone(CLONE_VM|CLONE_VFORK), so it doesn't copy the parent page tables
+// and the time to start a process doesn't depend on the parent memory size.
+static pid_t bfutils_process_posix_spawn(char *const *cmd, int stdin_fd, int stdout_fd, int stderr_fd) {
+    posix_spawn_file_actions_t actions;
+    int error = posix_spawn_file_actions_init(&actions);
+    if (error != 0) {
+        errno = error;
+        return -1;
     }
-    if (pipe(stdout_fd) < 0) {
-        close_pair(stdin_fd);
-        return process;
+    pid_t pid = -1;
+    int fds[3] = {stdin_fd, stdout_fd, stderr_fd};
+    // An inherited stream is already in place, so there's nothing to duplicate.
+    for (int i = 0; i < 3 && error == 0; i++) {
+        if (fds[i] != i) {
+            error = posix_spawn_file_actions_adddup2(&actions, fds[i], i);
+        }
     }
-    if (pipe(stderr_fd) < 0) {
-        close_pair(stdin_fd);
-        close_pair(stdout_fd);
-        return process;
+    if (error == 0) {
+        error = posix_spawnp(&pid, cmd[0], &actions, NULL, cmd, environ);
     }
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return pid;
+}
+#endif //BFUTILS_PROCESS_USE_FORK
 
-    if (!set_fds_nonblock(stdout_fd, stderr_fd)){
-        close_pair(stdin_fd);
-        close_pair(stdout_fd);
-        close_pair(stderr_fd);
-        return process;
+// posix_spawn can't set resource limits before exec, so processes with limits are always started with fork.
+static pid_t bfutils_process_spawn(char *const *cmd, int stdin_fd, int stdout_fd, int stderr_fd, const BFUtilsProcessLimit *limits, size_t limits_len) {
+#ifndef BFUTILS_PROCESS_USE_FORK
+    if (limits_len == 0) {
+        return bfutils_process_posix_spawn(cmd, stdin_fd, stdout_fd, stderr_fd);
     }
+#endif //BFUTILS_PROCESS_USE_FORK
+    return bfutils_process_fork(cmd, stdin_fd, stdout_fd, stderr_fd, limits, limits_len);
+}
 
-    pid_t pid;
-    pid = fork();
-    switch (pid) {
-        case -1:
-            return process;
-        case 0:
-            if (dup2(stdin_fd[0], STDIN_FILENO) < 0) {
-                perror("dup2");
-                exit(1);
+// Opens the child end of a standard stream (0, 1 or 2) as described by redirect. For pipes, the parent end is placed at *parent_fd.
+static int bfutils_process_redirect_open(BFUtilsProcessRedirect redirect, int stream, int *child_fd, int *parent_fd) {
+    *child_fd = -1;
+    *parent_fd = -1;
+    switch (redirect.type) {
+        case BFUTILS_PROCESS_REDIRECT_PIPE: {
+            int fd[2];
+            if (!bfutils_process_pipe(fd)) {
+                return 0;
             }
-            close_pair(stdin_fd);
-
-            if (dup2(stdout_fd[1], STDOUT_FILENO) < 0) {
-                perror("dup2");
-                exit(1);
+            *child_fd = stream == STDIN_FILENO ? fd[0] : fd[1];
+            *parent_fd = stream == STDIN_FILENO ? fd[1] : fd[0];
+            // Only the ends used by the parent are non-blocking, the child gets normal blocking pipes.
+            if (!bfutils_process_set_nonblock(*parent_fd)) {
+                close_pair(fd);
+                return 0;
             }
-            close_pair(stdout_fd);
-
-            if (dup2(stderr_fd[1], STDERR_FILENO) < 0) {
-                perror("dup2");
-                exit(1);
+            return 1;
+        }
+        case BFUTILS_PROCESS_REDIRECT_FD:
+            // The copy is above the standard streams, so redirecting to the parent stdout or stderr works in any order.
+            *child_fd = fcntl(redirect.fd, F_DUPFD_CLOEXEC, 3);
+            return *child_fd >= 0;
+        case BFUTILS_PROCESS_REDIRECT_FILE:
+            if (stream == STDIN_FILENO) {
+                *child_fd = open(redirect.path, O_RDONLY | O_CLOEXEC);
+            }
+            else {
+                *child_fd = open(redirect.path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
             }
-            close_pair(stderr_fd);
+            return *child_fd >= 0;
+        case BFUTILS_PROCESS_REDIRECT_INHERIT:
+            *child_fd = stream;
+            return 1;
+    }
+    return 0;
+}
 
-            execvp(cmd[0], cmd);
+BFUtilsProcess bfutils_process_async_fn(BFUtilsProcessOptions options) {
+    BFUtilsProcess process = {.pid = -1, .pid_fd = -1, .stdin_fd = -1, .stdout_fd = -1, .stderr_fd = -1};
+    char *const *cmd = options.cmd;
+    if(cmd == NULL || *cmd == NULL) {
+        return process;
+    }
+    BFUtilsProcessRedirect redirects[3] = {options.in, options.out, options.err};
+    int child_fd[3] = {-1, -1, -1};
+    int parent_fd[3] = {-1, -1, -1};
+    pid_t pid = -1;
+
+    int stream;
+    for (stream = 0; stream < 3; stream++) {
+        if (!bfutils_process_redirect_open(redirects[stream], stream, &child_fd[stream], &parent_fd[stream])) {
             break;
-        default:
-            process.pid = pid;
-            process.stdin_fd = stdin_fd[1];
-            process.stdout_fd = stdout_fd[0];
-            process.stderr_fd = stderr_fd[0];
-            close(stdin_fd[0]);
-            close(stdout_fd[1]);
-            close(stderr_fd[1]);
+        }
+    }
+    if (stream == 3) {
+        clock_gettime(CLOCK_MONOTONIC, &process.start_time);
+        pid = bfutils_process_spawn(cmd, child_fd[0], child_fd[1], child_fd[2], options.limits, options.limits_len);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (child_fd[i] > STDERR_FILENO) {
+            close(child_fd[i]);
+        }
+        if (pid < 0 && parent_fd[i] >= 0) {
+            close(parent_fd[i]);
+        }
     }
+    if (pid < 0) {
+        return process;
+    }
+
+    process.pid = pid;
+    process.stdin_fd = parent_fd[0];
+    process.stdout_fd = parent_fd[1];
+    process.stderr_fd = parent_fd[2];
     return process;
 }
 
+BFUtilsProcess bfutils_process_async(char *const *cmd) {
+    return bfutils_process_async_fn((BFUtilsProcessOptions) {.cmd = cmd});
+}
+
+typedef struct {
+    BFUtilsProcessBuffer out;
+    BFUtilsProcessBuffer err;
+} BFUtilsProcessOutput;
+
+static void bfutils_process_sync_stdout(const char *data, size_t length, void *user_data) {
+    bfutils_process_buffer_append(data, length, &((BFUtilsProcessOutput*) user_data)->out);
+}
+
+static void bfutils_process_sync_stderr(const char *data, size_t length, void *user_data) {
+    bfutils_process_buffer_append(data, length, &((BFUtilsProcessOutput*) user_data)->err);
+}
+
 int bfutils_process_sync(char *const *cmd, const char *in, char **out, char **err) {
+    return bfutils_process_sync_n(cmd, in, in ? strlen(in) : 0, out, NULL, err, NULL);
+}
+
+int bfutils_process_sync_n(char *const *cmd, const char *in, size_t in_len, char **out, size_t *out_len, char **err, size_t *err_len) {
     BFUtilsProcess process = bfutils_process_async(cmd);
     if (process.pid < 0) {
         return -1;
     }
 
-    bfutils_process_write_stdin(&process, in);
+    BFUtilsProcessOutput output = {0};
+    bfutils_process_communicate(&process, in, in_len,
+            out ? bfutils_process_sync_stdout : NULL,
+            err ? bfutils_process_sync_stderr : NULL,
+            &output);
     int status = bfutils_process_wait(&process);
     
     if (out != NULL) {
-        *out = bfutils_process_read_stdout(&process);
+        bfutils_process_buffer_append("", 0, &output.out);
+        *out = output.out.data;
+        if (out_len != NULL) {
+            *out_len = output.out.length;
+        }
     }
 
     if (err != NULL) {
-        *err = bfutils_process_read_stderr(&process);
+        bfutils_process_buffer_append("", 0, &output.err);
+        *err = output.err.data;
+        if (err_len != NULL) {
+            *err_len = output.err.length;
+        }
     }
     bfutils_process_close(&process);
 
     return status;
 }
 
+int bfutils_process_communicate(BFUtilsProcess *p, const char *in, size_t in_len, BFUtilsProcessOutputCallback on_stdout, BFUtilsProcessOutputCallback on_stderr, void *user_data) {
+    if (in == NULL) {
+        in_len = 0;
+    }
+    if (in_len == 0 && p->stdin_fd >= 0) {
+        close(p->stdin_fd);
+        p->stdin_fd = -1;
+    }
+    sigset_t old_mask;
+    bfutils_process_block_sigpipe(&old_mask);
+
+    int result = 0;
+    size_t written = 0;
+    int fds_open[2] = {p->stdout_fd >= 0, p->stderr_fd >= 0};
+    int output_fds[2] = {p->stdout_fd, p->stderr_fd};
+    BFUtilsProcessOutputCallback callbacks[2] = {on_stdout, on_stderr};
+    char buffer[65536];
+    while (p->stdin_fd >= 0 || fds_open[0] || fds_open[1]) {
+        struct pollfd fds[3];
+        int indexes[3] = {-1, -1, -1};
+        nfds_t nfds = 0;
+        if (p->stdin_fd >= 0) {
+            indexes[2] = nfds;
+            fds[nfds++] = (struct pollfd) {.fd = p->stdin_fd, .events = POLLOUT};
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds_open[i]) {
+                indexes[i] = nfds;
+                fds[nfds++] = (struct pollfd) {.fd = output_fds[i], .events = POLLIN};
+            }
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+
+        if (indexes[2] >= 0 && fds[indexes[2]].revents) {
+            ssize_t n = write(p->stdin_fd, in + written, in_len - written);
+            if (n > 0) {
+                written += n;
+            }
+            if (written == in_len || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                close(p->stdin_fd);
+                p->stdin_fd = -1;
+            }
+        }
+        for (int i = 0; i < 2; i++) {
+            if (indexes[i] < 0 || fds[indexes[i]].revents == 0) {
+                continue;
+            }
+            ssize_t n = read(output_fds[i], buffer, sizeof(buffer));
+            if (n > 0) {
+                if (callbacks[i] != NULL) {
+                    callbacks[i](buffer, n, user_data);
+                }
+            }
+            else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                fds_open[i] = 0;
+            }
+        }
+    }
+
+    bfutils_process_restore_sigpipe(&old_mask);
+    return result;
+}
+
+typedef struct {
+    int active;
+    size_t job;
+    BFUtilsProcess process;
+    size_t written;
+    int open[2];
+    BFUtilsProcessBuffer output[2];
+} BFUtilsProcessPoolSlot;
+
+static void bfutils_process_pool_finish(BFUtilsProcessPoolSlot *slot, BFUtilsProcessJob *job, int status, BFUtilsProcessJobCallback on_complete, void *user_data) {
+    job->status = bfutils_process_exit_status(status);
+    bfutils_process_buffer_append("", 0, &slot->output[0]);
+    bfutils_process_buffer_append("", 0, &slot->output[1]);
+    job->out = slot->output[0].data;
+    job->out_len = slot->output[0].length;
+    job->err = slot->output[1].data;
+    job->err_len = slot->output[1].length;
+    bfutils_process_close(&slot->process);
+    slot->active = 0;
+    if (on_complete != NULL) {
+        on_complete(job, user_data);
+    }
+}
+
+int bfutils_process_pool_run(BFUtilsProcessJob *jobs, size_t jobs_len, int max_running, BFUtilsProcessJobCallback on_complete, void *user_data) {
+    if (max_running <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_running = cpus > 0 ? (int) cpus : 1;
+    }
+    BFUtilsProcessPoolSlot *slots = (BFUtilsProcessPoolSlot*) BFUTILS_PROCESS_CALLOC(max_running, sizeof(BFUtilsProcessPoolSlot));
+    struct pollfd *fds = (struct pollfd*) BFUTILS_PROCESS_MALLOC(sizeof(struct pollfd) * max_running * 3);
+    int *fd_slot = (int*) BFUTILS_PROCESS_MALLOC(sizeof(int) * max_running * 3);
+    int *fd_stream = (int*) BFUTILS_PROCESS_MALLOC(sizeof(int) * max_running * 3);
+
+    int result = 0;
+    size_t next = 0;
+    int running = 0;
+    while (next < jobs_len || running > 0) {
+        // New processes are started before blocking SIGPIPE, so they don't inherit the blocked signal.
+        for (int i = 0; i < max_running && next < jobs_len; i++) {
+            if (slots[i].active) continue;
+            BFUtilsProcessJob *job = &jobs[next];
+            job->out = NULL;
+            job->err = NULL;
+            job->out_len = 0;
+            job->err_len = 0;
+            BFUtilsProcessPoolSlot *slot = &slots[i];
+            *slot = (BFUtilsProcessPoolSlot) {.active = 1, .job = next++, .process = bfutils_process_async(job->cmd)};
+            if (slot->process.pid < 0) {
+                slot->active = 0;
+                job->status = -1;
+                if (on_complete != NULL) {
+                    on_complete(job, user_data);
+                }
+                i--;
+                continue;
+            }
+            slot->open[0] = 1;
+            slot->open[1] = 1;
+            if (job->in == NULL || job->in_len == 0) {
+                close(slot->process.stdin_fd);
+                slot->process.stdin_fd = -1;
+            }
+            running++;
+        }
+
+        // Processes that closed all their pipes are reaped without blocking, or polled through their pidfd until they exit.
+        int waiting = 0;
+        nfds_t nfds = 0;
+        for (int i = 0; i < max_running; i++) {
+            BFUtilsProcessPoolSlot *slot = &slots[i];
+            if (!slot->active) continue;
+            if (slot->process.stdin_fd < 0 && !slot->open[0] && !slot->open[1]) {
+                int status;
+                pid_t pid = waitpid(slot->process.pid, &status, WNOHANG);
+                if (pid == 0) {
+                    int pid_fd = bfutils_process_pidfd(&slot->process);
+                    if (pid_fd < 0) {
+                        waiting = 1;
+                        continue;
+                    }
+                    fd_slot[nfds] = i;
+                    fd_stream[nfds] = 3;
+                    fds[nfds++] = (struct pollfd) {.fd = pid_fd, .events = POLLIN};
+                    continue;
+                }
+                bfutils_process_pool_finish(slot, &jobs[slot->job], pid < 0 ? -1 : status, on_complete, user_data);
+                running--;
+                continue;
+            }
+            if (slot->process.stdin_fd >= 0) {
+                fd_slot[nfds] = i;
+                fd_stream[nfds] = 2;
+                fds[nfds++] = (struct pollfd) {.fd = slot->process.stdin_fd, .events = POLLOUT};
+            }
+            int output_fds[2] = {slot->process.stdout_fd, slot->process.stderr_fd};
+            for (int k = 0; k < 2; k++) {
+                if (!slot->open[k]) continue;
+                fd_slot[nfds] = i;
+                fd_stream[nfds] = k;
+                fds[nfds++] = (struct pollfd) {.fd = output_fds[k], .events = POLLIN};
+            }
+        }
+        if (nfds == 0 && !waiting) {
+            continue;
+        }
+        if (poll(fds, nfds, waiting ? 10 : -1) < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+
+        sigset_t old_mask;
+        bfutils_process_block_sigpipe(&old_mask);
+
+        for (nfds_t j = 0; j < nfds; j++) {
+            // An exited process is reaped on the next iteration.
+            if (fds[j].revents == 0 || fd_stream[j] == 3) continue;
+            BFUtilsProcessPoolSlot *slot = &slots[fd_slot[j]];
+            BFUtilsProcessJob *job = &jobs[slot->job];
+            if (fd_stream[j] == 2) {
+                ssize_t n = write(slot->process.stdin_fd, job->in + slot->written, job->in_len - slot->written);
+                if (n > 0) {
+                    slot->written += n;
+                }
+                if (slot->written == job->in_len || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                    close(slot->process.stdin_fd);
+                    slot->process.stdin_fd = -1;
+                }
+                continue;
+            }
+            int k = fd_stream[j];
+            BFUtilsProcessBuffer *buffer = &slot->output[k];
+            bfutils_process_buffer_reserve(buffer, BFUTILS_PROCESS_READ_SIZE);
+            ssize_t n = read(fds[j].fd, buffer->data + buffer->length, buffer->capacity - buffer->length - 1);
+            if (n > 0) {
+                buffer->length += n;
+            }
+            else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                slot->open[k] = 0;
+            }
+        }
+        bfutils_process_restore_sigpipe(&old_mask);
+    }
+
+    // On failure the jobs still running are killed and reaped, so no child or pipe outlives the call.
+    for (int i = 0; i < max_running; i++) {
+        BFUtilsProcessPoolSlot *slot = &slots[i];
+        if (!slot->active) continue;
+        kill(slot->process.pid, SIGKILL);
+        while (waitpid(slot->process.pid, NULL, 0) < 0 && errno == EINTR);
+        bfutils_process_close(&slot->process);
+        BFUTILS_PROCESS_FREE(slot->output[0].data);
+        BFUTILS_PROCESS_FREE(slot->output[1].data);
+        slot->active = 0;
+        jobs[slot->job].status = -1;
+    }
+
+    BFUTILS_PROCESS_FREE(fd_stream);
+    BFUTILS_PROCESS_FREE(fd_slot);
+    BFUTILS_PROCESS_FREE(fds);
+    BFUTILS_PROCESS_FREE(slots);
+    return result;
+}
+
+BFUtilsProcessPipeline bfutils_process_pipeline(char *const *const *cmds, size_t cmds_len) {
+    BFUtilsProcessPipeline pipeline = {.process = {.pid = -1, .pid_fd = -1, .stdin_fd = -1, .stdout_fd = -1, .stderr_fd = -1}};
+    if (cmds == NULL || cmds_len == 0) {
+        return pipeline;
+    }
+    int stdin_fd[2];
+    int stderr_fd[2];
+    if (!bfutils_process_pipe(stdin_fd)) {
+        return pipeline;
+    }
+    if (!bfutils_process_pipe(stderr_fd)) {
+        close_pair(stdin_fd);
+        return pipeline;
+    }
+    if (!bfutils_process_set_nonblock(stdin_fd[1]) || !bfutils_process_set_nonblock(stderr_fd[0])) {
+        close_pair(stdin_fd);
+        close_pair(stderr_fd);
+        return pipeline;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &pipeline.process.start_time);
+    pid_t *pids = (pid_t*) BFUTILS_PROCESS_MALLOC(sizeof(pid_t) * cmds_len);
+    // Each stage reads from the pipe written by the previous one, so the data never passes through the parent.
+    int input = stdin_fd[0];
+    size_t i;
+    for (i = 0; i < cmds_len; i++) {
+        int output[2];
+        if (cmds[i] == NULL || cmds[i][0] == NULL || !bfutils_process_pipe(output)) {
+            break;
+        }
+        if (i == cmds_len - 1 && !bfutils_process_set_nonblock(output[0])) {
+            close_pair(output);
+            break;
+        }
+        pid_t pid = bfutils_process_spawn(cmds[i], input, output[1], stderr_fd[1], NULL, 0);
+        close(input);
+        close(output[1]);
+        input = output[0];
+        if (pid < 0) {
+            break;
+        }
+        pids[i] = pid;
+    }
+    close(stderr_fd[1]);
+
+    if (i < cmds_len) {
+        // Closing the pipes makes the stages already started receive EOF, so they can be reaped.
+        close(input);
+        close(stdin_fd[1]);
+        close(stderr_fd[0]);
+        for (size_t j = 0; j < i; j++) {
+            waitpid(pids[j], NULL, 0);
+        }
+        BFUTILS_PROCESS_FREE(pids);
+        return pipeline;
+    }
+
+    pipeline.pids = pids;
+    pipeline.length = cmds_len;
+    pipeline.process.pid = pids[cmds_len - 1];
+    pipeline.process.stdin_fd = stdin_fd[1];
+    pipeline.process.stdout_fd = input;
+    pipeline.process.stderr_fd = stderr_fd[0];
+    return pipeline;
+}
+
+int bfutils_process_pipeline_wait(BFUtilsProcessPipeline *pipeline, int *statuses) {
+    if (pipeline->process.stdin_fd >= 0) {
+        close(pipeline->process.stdin_fd);
+        pipeline->process.stdin_fd = -1;
+    }
+    int result = 0;
+    for (size_t i = 0; i < pipeline->length; i++) {
+        int status;
+        if (waitpid(pipeline->pids[i], &status, 0) < 0) {
+            status = -1;
+        }
+        status = bfutils_process_exit_status(status);
+        if (statuses != NULL) {
+            statuses[i] = status;
+        }
+        if (status != 0) {
+            result = status;
+        }
+    }
+    return result;
+}
+
+void bfutils_process_pipeline_close(BFUtilsProcessPipeline *pipeline) {
+    bfutils_process_close(&pipeline->process);
+    BFUTILS_PROCESS_FREE(pipeline->pids);
+    pipeline->pids = NULL;
+    pipeline->length = 0;
+}
+
+// Waits until the non-blocking stdin can be written again.
+static int bfutils_process_wait_writable(int fd) {
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Writes everything to fd, waiting while the pipe is full. SIGPIPE needs to be blocked by the caller.
+static int bfutils_process_write_all(int fd, const char *data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = write(fd, data + written, length - written);
+        if (n >= 0) {
+            written += n;
+        }
+        else if (errno == EAGAIN) {
+            if (!bfutils_process_wait_writable(fd)) {
+                return -1;
+            }
+        }
+        else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int bfutils_process_send_file(BFUtilsProcess *p, int fd) {
+    if (p->stdin_fd < 0) {
+        return -1;
+    }
+    sigset_t old_mask;
+    bfutils_process_block_sigpipe(&old_mask);
+    int result = 0;
+    int fallback = 1;
+
+#ifdef __linux__
+    // sendfile moves the data from the file to the pipe inside the kernel, so it's never copied to user space.
+    fallback = 0;
+    while (1) {
+        ssize_t n = sendfile(p->stdin_fd, fd, NULL, 1 << 30);
+        if (n > 0) continue;
+        if (n == 0) break;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) {
+            if (bfutils_process_wait_writable(p->stdin_fd)) continue;
+            result = -1;
+        }
+        // The file doesn't support sendfile (e.g. it's a pipe or socket), so it falls back to read and write.
+        else if (errno == EINVAL || errno == ENOSYS) {
+            fallback = 1;
+        }
+        else {
+            result = -1;
+        }
+        break;
+    }
+#endif //__linux__
+
+    char buffer[BFUTILS_PROCESS_READ_SIZE];
+    while (fallback && result == 0) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = -1;
+            break;
+        }
+        result = bfutils_process_write_all(p->stdin_fd, buffer, n);
+    }
+    bfutils_process_restore_sigpipe(&old_mask);
+    return result;
+}
+
+ssize_t bfutils_process_write_stdin_n(BFUtilsProcess *p, const char *data, size_t length) {
+    struct iovec iov = {.iov_base = (void*) data, .iov_len = length};
+    return bfutils_process_writev_stdin(p, &iov, 1);
+}
+
+ssize_t bfutils_process_writev_stdin(BFUtilsProcess *p, const struct iovec *iov, int iovcnt) {
+    if (p->stdin_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    sigset_t old_mask;
+    bfutils_process_block_sigpipe(&old_mask);
+    ssize_t n;
+    while ((n = writev(p->stdin_fd, iov, iovcnt)) < 0 && errno == EINTR);
+    if (n < 0 && errno == EAGAIN) {
+        n = 0;
+    }
+    int error = errno;
+    bfutils_process_restore_sigpipe(&old_mask);
+    errno = error;
+    return n;
+}
+
 void bfutils_process_write_stdin(BFUtilsProcess *p, const char *in) {
     if (in != NULL) {
-        int wrote = 0;
-        int len = strlen(in);
-        do {
-            wrote += write(p->stdin_fd, in, len);
-        } while (wrote < len);
+        sigset_t old_mask;
+        bfutils_process_block_sigpipe(&old_mask);
+        bfutils_process_write_all(p->stdin_fd, in, strlen(in));
+        bfutils_process_restore_sigpipe(&old_mask);
+    }
+}
+
+// Reads exactly length bytes, waiting while the pipe is empty. EOF means the worker exited, reported as EPIPE.
+static int bfutils_process_read_exact(int fd, char *data, size_t length) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = read(fd, data + got, length - got);
+        if (n > 0) {
+            got += n;
+        }
+        else if (n == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        else if (errno == EAGAIN) {
+            struct pollfd pfd = {.fd = fd, .events = POLLIN};
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                return -1;
+            }
+        }
+        else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int bfutils_process_worker_start(BFUtilsProcessWorker *w, char *const *cmd) {
+    w->cmd = cmd;
+    w->stopped = 0;
+    // The worker stderr is not read, so it goes to the caller stderr instead of filling a pipe.
+    w->process = bfutils_process_async_with(.cmd = cmd, .err = bfutils_process_redirect_inherit());
+    return w->process.pid > 0 ? 0 : -1;
+}
+
+int bfutils_process_worker_restart(BFUtilsProcessWorker *w) {
+    if (w->process.pid > 0) {
+        kill(w->process.pid, SIGKILL);
+        bfutils_process_wait(&w->process);
+    }
+    bfutils_process_close(&w->process);
+    w->restarts++;
+    return bfutils_process_worker_start(w, w->cmd);
+}
+
+int bfutils_process_worker_send(BFUtilsProcessWorker *w, const char *request, size_t request_len) {
+    if (w->process.stdin_fd < 0 || request_len > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t header = htonl((uint32_t) request_len);
+    struct iovec iov[2] = {{.iov_base = &header, .iov_len = sizeof(header)}, {.iov_base = (void*) request, .iov_len = request_len}};
+
+    sigset_t old_mask;
+    bfutils_process_block_sigpipe(&old_mask);
+    // Most frames fit in the pipe, so they are sent with a single writev. The rest is written as the worker reads it.
+    ssize_t n;
+    while ((n = writev(w->process.stdin_fd, iov, 2)) < 0 && errno == EINTR);
+    if (n < 0 && errno == EAGAIN) {
+        n = 0;
+    }
+    int result = n < 0 ? -1 : 0;
+    if (result == 0 && (size_t) n < sizeof(header)) {
+        result = bfutils_process_write_all(w->process.stdin_fd, (char*) &header + n, sizeof(header) - n);
+        n = sizeof(header);
+    }
+    if (result == 0) {
+        size_t sent = n - sizeof(header);
+        result = bfutils_process_write_all(w->process.stdin_fd, request + sent, request_len - sent);
+    }
+    int error = errno;
+    bfutils_process_restore_sigpipe(&old_mask);
+    errno = error;
+    return result;
+}
+
+// The response buffer is reused by the next responses, so a call doesn't allocate once it's large enough. It has space for a \0.
+static void bfutils_process_worker_reserve(BFUtilsProcessWorker *w, size_t length) {
+    if (length + 1 > w->buffer_capacity) {
+        size_t capacity = w->buffer_capacity > 0 ? w->buffer_capacity : 4096;
+        while (capacity < length + 1) {
+            capacity *= 2;
+        }
+        w->buffer = (char*) BFUTILS_PROCESS_REALLOC(w->buffer, capacity);
+        w->buffer_capacity = capacity;
+    }
+}
+
+int bfutils_process_worker_receive(BFUtilsProcessWorker *w, char **response, size_t *response_len) {
+    uint32_t header;
+    if (w->process.stdout_fd < 0 || bfutils_process_read_exact(w->process.stdout_fd, (char*) &header, sizeof(header)) < 0) {
+        return -1;
+    }
+    size_t length = ntohl(header);
+    bfutils_process_worker_reserve(w, length);
+    if (bfutils_process_read_exact(w->process.stdout_fd, w->buffer, length) < 0) {
+        return -1;
+    }
+    w->buffer[length] = '\0';
+    *response = w->buffer;
+    if (response_len != NULL) {
+        *response_len = length;
+    }
+    return 0;
+}
+
+// Sends the request while reading the response, so a worker that starts answering before reading the whole request can't deadlock.
+// *sent is set once any byte of the request was written.
+static int bfutils_process_worker_exchange(BFUtilsProcessWorker *w, const char *request, size_t request_len, char **response, size_t *response_len, int *sent) {
+    *sent = 0;
+    // process_wait closes the stdin, so a worker that was waited for is restarted like one that died.
+    if (w->process.stdin_fd < 0) {
+        errno = EPIPE;
+        return -1;
+    }
+    uint32_t out_header = htonl((uint32_t) request_len);
+    size_t out_done = 0;
+    size_t out_total = sizeof(out_header) + request_len;
+    uint32_t in_header;
+    size_t in_done = 0;
+    size_t in_total = sizeof(in_header);
+
+    sigset_t old_mask;
+    bfutils_process_block_sigpipe(&old_mask);
+    int result = 0;
+    while (in_done < in_total) {
+        int progress = 0;
+        if (out_done < out_total) {
+            struct iovec iov[2];
+            int iovcnt = 0;
+            if (out_done < sizeof(out_header)) {
+                iov[iovcnt++] = (struct iovec) {.iov_base = (char*) &out_header + out_done, .iov_len = sizeof(out_header) - out_done};
+                iov[iovcnt++] = (struct iovec) {.iov_base = (void*) request, .iov_len = request_len};
+            }
+            else {
+                iov[iovcnt++] = (struct iovec) {.iov_base = (void*) (request + out_done - sizeof(out_header)), .iov_len = out_total - out_done};
+            }
+            ssize_t n = writev(w->process.stdin_fd, iov, iovcnt);
+            if (n > 0) {
+                out_done += n;
+                *sent = 1;
+                progress = 1;
+            }
+            else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                result = -1;
+                break;
+            }
+        }
+
+        char *destination = in_done < sizeof(in_header) ? (char*) &in_header + in_done : w->buffer + in_done - sizeof(in_header);
+        size_t wanted = in_done < sizeof(in_header) ? sizeof(in_header) - in_done : in_total - in_done;
+        ssize_t n = read(w->process.stdout_fd, destination, wanted);
+        if (n > 0) {
+            in_done += n;
+            progress = 1;
+            if (in_done == sizeof(in_header)) {
+                in_total += ntohl(in_header);
+                bfutils_process_worker_reserve(w, in_total - sizeof(in_header));
+            }
+        }
+        else if (n == 0) {
+            errno = EPIPE;
+            result = -1;
+            break;
+        }
+        else if (errno != EAGAIN && errno != EINTR) {
+            result = -1;
+            break;
+        }
+
+        if (!progress) {
+            struct pollfd fds[2] = {{.fd = w->process.stdout_fd, .events = POLLIN}, {.fd = w->process.stdin_fd, .events = POLLOUT}};
+            if (poll(fds, out_done < out_total ? 2 : 1, -1) < 0 && errno != EINTR) {
+                result = -1;
+                break;
+            }
+        }
+    }
+    // The rest of the request still needs to be sent, so the next frame starts at the right place.
+    if (result == 0 && out_done < out_total) {
+        size_t done = out_done > sizeof(out_header) ? out_done - sizeof(out_header) : 0;
+        if (out_done < sizeof(out_header)) {
+            result = bfutils_process_write_all(w->process.stdin_fd, (char*) &out_header + out_done, sizeof(out_header) - out_done);
+        }
+        if (result == 0) {
+            result = bfutils_process_write_all(w->process.stdin_fd, request + done, request_len - done);
+        }
+    }
+    int error = errno;
+    bfutils_process_restore_sigpipe(&old_mask);
+    errno = error;
+    if (result < 0) {
+        return -1;
+    }
+
+    size_t length = in_total - sizeof(in_header);
+    if (length == 0) {
+        bfutils_process_worker_reserve(w, 0);
+    }
+    w->buffer[length] = '\0';
+    *response = w->buffer;
+    if (response_len != NULL) {
+        *response_len = length;
+    }
+    return 0;
+}
+
+int bfutils_process_worker_call(BFUtilsProcessWorker *w, const char *request, size_t request_len, char **response, size_t *response_len) {
+    // A request that can't be framed, or a worker that was stopped, is an error of the caller and doesn't restart the worker.
+    if (w->stopped || request_len > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    // The last restart failed, so it's tried again instead of losing the worker to a transient error.
+    if (w->process.stdout_fd < 0 && bfutils_process_worker_restart(w) < 0) {
+        return -1;
+    }
+    int sent;
+    if (bfutils_process_worker_exchange(w, request, request_len, response, response_len, &sent) == 0) {
+        return 0;
+    }
+    // If the worker didn't receive any of the request, it's safe to send it again to a new worker.
+    if (!sent && bfutils_process_worker_restart(w) == 0 && bfutils_process_worker_exchange(w, request, request_len, response, response_len, &sent) == 0) {
+        return 0;
     }
+    // Otherwise the request may have been processed, so it's not sent again, but the next calls go to a new worker.
+    bfutils_process_worker_restart(w);
+    return -1;
+}
+
+void bfutils_process_worker_stop(BFUtilsProcessWorker *w) {
+    if (w->process.pid > 0) {
+        // Closing the stdin is the signal for the worker to exit.
+        bfutils_process_wait(&w->process);
+    }
+    bfutils_process_close(&w->process);
+    BFUTILS_PROCESS_FREE(w->buffer);
+    w->buffer = NULL;
+    w->buffer_capacity = 0;
+    w->stopped = 1;
+}
+
+int bfutils_process_worker_pool_start(BFUtilsProcessWorkerPool *pool, char *const *cmd, size_t length) {
+    if (length == 0) {
+        *pool = (BFUtilsProcessWorkerPool) {0};
+        errno = EINVAL;
+        return -1;
+    }
+    pool->workers = (BFUtilsProcessWorker*) BFUTILS_PROCESS_CALLOC(length, sizeof(BFUtilsProcessWorker));
+    pool->length = length;
+    pool->next = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (bfutils_process_worker_start(&pool->workers[i], cmd) < 0) {
+            pool->length = i;
+            bfutils_process_worker_pool_stop(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+BFUtilsProcessWorker *bfutils_process_worker_pool_next(BFUtilsProcessWorkerPool *pool) {
+    if (pool->length == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    BFUtilsProcessWorker *w = &pool->workers[pool->next];
+    pool->next = (pool->next + 1) % pool->length;
+    return w;
+}
+
+int bfutils_process_worker_pool_call(BFUtilsProcessWorkerPool *pool, const char *request, size_t request_len, char **response, size_t *response_len) {
+    BFUtilsProcessWorker *w = bfutils_process_worker_pool_next(pool);
+    if (w == NULL) {
+        return -1;
+    }
+    return bfutils_process_worker_call(w, request, request_len, response, response_len);
+}
+
+void bfutils_process_worker_pool_stop(BFUtilsProcessWorkerPool *pool) {
+    for (size_t i = 0; i < pool->length; i++) {
+        bfutils_process_worker_stop(&pool->workers[i]);
+    }
+    BFUTILS_PROCESS_FREE(pool->workers);
+    pool->workers = NULL;
+    pool->length = 0;
 }
 
 char *bfutils_process_read_stdout(BFUtilsProcess *p) {
@@ -300,49 +1551,316 @@ char *bfutils_process_read_stderr(BFUtilsProcess *p) {
     return out;
 }
 
+char *bfutils_process_read_stdout_n(BFUtilsProcess *p, size_t *length) {
+    char *out;
+    size_t l = read_fd(p->stdout_fd, &out);
+    if (length != NULL) {
+        *length = l;
+    }
+    return out;
+}
+
+char *bfutils_process_read_stderr_n(BFUtilsProcess *p, size_t *length) {
+    char *out;
+    size_t l = read_fd(p->stderr_fd, &out);
+    if (length != NULL) {
+        *length = l;
+    }
+    return out;
+}
+
+#ifdef BFUTILS_VECTOR_H
+char *bfutils_process_read_fd_vector(int fd, char *vector) {
+    while (1) {
+        size_t length = bfutils_vector_length(vector);
+        if (bfutils_vector_capacity(vector) < length + BFUTILS_PROCESS_READ_SIZE + 1) {
+            size_t capacity = bfutils_vector_capacity(vector) * 2;
+            vector = bfutils_vector_capacity_grow(vector, sizeof(char), capacity > length + BFUTILS_PROCESS_READ_SIZE + 1 ? capacity : length + BFUTILS_PROCESS_READ_SIZE + 1);
+        }
+        ssize_t n = read(fd, vector + length, bfutils_vector_capacity(vector) - length - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        bfutils_vector_header(vector)->length += n;
+    }
+    vector[bfutils_vector_length(vector)] = '\0'; //Inserts \0 without incrementing length
+    return vector;
+}
+#endif //BFUTILS_VECTOR_H
+
+int bfutils_process_pidfd(BFUtilsProcess *p) {
+#ifdef BFUTILS_PROCESS_HAS_PIDFD
+    if (!p->pid_fd_owned && p->pid > 0) {
+        // The pidfd is created with close-on-exec set.
+        int fd = syscall(SYS_pidfd_open, p->pid, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        p->pid_fd = fd;
+        p->pid_fd_owned = 1;
+    }
+    return p->pid_fd_owned ? p->pid_fd : -1;
+#else
+    (void) p;
+    return -1;
+#endif //BFUTILS_PROCESS_HAS_PIDFD
+}
+
+// Reaps the process if it already exited, returning 1 and placing its exit status at *status.
+static int bfutils_process_try_reap(BFUtilsProcess *p, int *status) {
+    int s;
+    pid_t pid = waitpid(p->pid, &s, WNOHANG);
+    if (pid == 0 || (pid < 0 && errno == EINTR)) {
+        return 0;
+    }
+    if (status != NULL) {
+        *status = pid < 0 ? -1 : bfutils_process_exit_status(s);
+    }
+    if (p->pid_fd_owned) {
+        close(p->pid_fd);
+        p->pid_fd_owned = 0;
+    }
+    p->pid_fd = -1;
+    p->pid = -1;
+    return 1;
+}
+
+#ifdef __linux__
+// Without pidfd_open (Linux < 5.3), SIGCHLD is received through a signalfd, which is readable when any child exits.
+// The signalfd only sees the signal while it's blocked, so the caller blocks it with bfutils_process_block_sigchld.
+static int bfutils_process_sigchld_fd(void) {
+    static int fd = -1;
+    if (fd < 0) {
+        sigset_t sigchld;
+        sigemptyset(&sigchld);
+        sigaddset(&sigchld, SIGCHLD);
+        fd = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+    return fd;
+}
+
+static void bfutils_process_block_sigchld(sigset_t *old_mask) {
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld, old_mask);
+}
+#endif //__linux__
+
+static long bfutils_process_elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+long bfutils_process_wait_any(BFUtilsProcess *processes, size_t length, int timeout, int *status) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct pollfd *fds = (struct pollfd*) BFUTILS_PROCESS_MALLOC(sizeof(struct pollfd) * (length + 1));
+    size_t *fd_process = (size_t*) BFUTILS_PROCESS_MALLOC(sizeof(size_t) * (length + 1));
+    long result = -1;
+    int sigchld_blocked = 0;
+    sigset_t old_mask;
+
+    while (1) {
+        nfds_t nfds = 0;
+        int fallback = 0;
+        int alive = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (processes[i].pid <= 0) continue;
+            alive = 1;
+            int fd = bfutils_process_pidfd(&processes[i]);
+            if (fd < 0) {
+                // Processes without a pidfd are checked on every wake up.
+                fallback = 1;
+                if (bfutils_process_try_reap(&processes[i], status)) {
+                    result = i;
+                    break;
+                }
+                continue;
+            }
+            fd_process[nfds] = i;
+            fds[nfds++] = (struct pollfd) {.fd = fd, .events = POLLIN};
+        }
+        if (result >= 0) break;
+        if (!alive) {
+            errno = ECHILD;
+            break;
+        }
+
+        int poll_timeout = timeout;
+        if (timeout >= 0) {
+            long elapsed = bfutils_process_elapsed_ms(&start);
+            poll_timeout = elapsed >= timeout ? 0 : timeout - elapsed;
+        }
+        int sigchld_fd = -1;
+        if (fallback) {
+#ifdef __linux__
+            if (!sigchld_blocked) {
+                // The processes are checked again after blocking SIGCHLD, so an exit before this point is not missed.
+                bfutils_process_block_sigchld(&old_mask);
+                sigchld_blocked = 1;
+                continue;
+            }
+            sigchld_fd = bfutils_process_sigchld_fd();
+#endif //__linux__
+            if (sigchld_fd >= 0) {
+                fd_process[nfds] = length;
+                fds[nfds++] = (struct pollfd) {.fd = sigchld_fd, .events = POLLIN};
+            }
+            else if (poll_timeout < 0 || poll_timeout > 10) {
+                poll_timeout = 10;
+            }
+        }
+
+        int ready = poll(fds, nfds, poll_timeout);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        for (nfds_t j = 0; ready > 0 && j < nfds; j++) {
+            if (fds[j].revents == 0) continue;
+            if (fd_process[j] == length) {
+#ifdef __linux__
+                struct signalfd_siginfo info;
+                while (read(sigchld_fd, &info, sizeof(info)) > 0);
+#endif //__linux__
+                continue;
+            }
+            if (bfutils_process_try_reap(&processes[fd_process[j]], status)) {
+                result = fd_process[j];
+                break;
+            }
+        }
+        if (result >= 0) break;
+        if (timeout >= 0 && bfutils_process_elapsed_ms(&start) >= timeout) {
+            errno = ETIMEDOUT;
+            break;
+        }
+    }
+
+#ifdef __linux__
+    if (sigchld_blocked) {
+        int saved_errno = errno;
+        // A SIGCHLD still pending is delivered here with the caller's disposition, and new children don't inherit a blocked SIGCHLD.
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        errno = saved_errno;
+    }
+#endif //__linux__
+    BFUTILS_PROCESS_FREE(fd_process);
+    BFUTILS_PROCESS_FREE(fds);
+    return result;
+}
+
+int bfutils_process_wait_timeout(BFUtilsProcess *p, int timeout, BFUtilsProcessUsage *usage) {
+    if (p->stdin_fd >= 0) {
+        close(p->stdin_fd);
+        p->stdin_fd = -1;
+    }
+    if (p->pid <= 0) {
+        return -1;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int signal_sent = 0;
+    int status;
+    struct rusage rusage;
+    while (1) {
+        pid_t pid = wait4(p->pid, &status, timeout < 0 ? 0 : WNOHANG, &rusage);
+        if (pid > 0) {
+            p->pid = -1;
+            break;
+        }
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        // After the timeout, the process receives SIGTERM and, if it's still running after the grace period, SIGKILL.
+        long elapsed = bfutils_process_elapsed_ms(&start);
+        long deadline = signal_sent == 0 ? timeout : (long) timeout + BFUTILS_PROCESS_KILL_GRACE_MS;
+        if (signal_sent != SIGKILL && elapsed >= deadline) {
+            signal_sent = signal_sent == 0 ? SIGTERM : SIGKILL;
+            kill(p->pid, signal_sent);
+            continue;
+        }
+        // The deadline can pass INT_MAX when the grace period is added to a large timeout.
+        long remaining_ms = deadline - elapsed;
+        int remaining = signal_sent == SIGKILL ? -1 : remaining_ms > INT_MAX ? INT_MAX : (int) remaining_ms;
+        int pid_fd = bfutils_process_pidfd(p);
+        if (pid_fd >= 0) {
+            struct pollfd fd = {.fd = pid_fd, .events = POLLIN};
+            poll(&fd, 1, remaining);
+        }
+        else {
+            poll(NULL, 0, remaining < 0 || remaining > 10 ? 10 : remaining);
+        }
+    }
+
+    if (usage != NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        usage->user_time = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec / 1e6;
+        usage->system_time = rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec / 1e6;
+        usage->wall_time = (now.tv_sec - p->start_time.tv_sec) + (now.tv_nsec - p->start_time.tv_nsec) / 1e9;
+        usage->max_rss = rusage.ru_maxrss;
+        usage->timed_out = signal_sent != 0;
+    }
+    return bfutils_process_exit_status(status);
+}
+
 int bfutils_process_wait(BFUtilsProcess *p) {
     int status;
-    close(p->stdin_fd);
+    if (p->stdin_fd >= 0) {
+        close(p->stdin_fd);
+        p->stdin_fd = -1;
+    }
+    // A pid of -1 would wait for any child.
+    if (p->pid <= 0) {
+        return -1;
+    }
     int wpid = waitpid(p->pid, &status, 0);
     if (wpid < 0) {
         return -1;
     }
-    if (WIFEXITED(status)) {
-        return WEXITSTATUS(status);
-    }
-    else if (WIFSIGNALED(status)) {
-        return WTERMSIG(status);
-    }
-    else if (WIFSTOPPED(status)) {
-        return WSTOPSIG(status);
-    }
-    return status;
+    // The pid may be reused after the process is reaped, so it's not used again.
+    p->pid = -1;
+    return bfutils_process_exit_status(status);
 }
 
 int bfutils_process_is_running(BFUtilsProcess *p, int *s) {
     int status;
-    close(p->stdin_fd);
+    if (p->stdin_fd >= 0) {
+        close(p->stdin_fd);
+        p->stdin_fd = -1;
+    }
+    if (p->pid <= 0) {
+        return -1;
+    }
     int wpid = waitpid(p->pid, &status, WNOHANG);
     if (wpid < 0) {
         return -1;
     }
-    if (wpid != 0 && s != NULL) {
-        if (WIFEXITED(status)) {
-            *s = WEXITSTATUS(status);
-        }
-        else if (WIFSIGNALED(status)) {
-            *s = WTERMSIG(status);
-        }
-        else if (WIFSTOPPED(status)) {
-            *s = WSTOPSIG(status);
+    if (wpid != 0) {
+        p->pid = -1;
+        if (s != NULL) {
+            *s = bfutils_process_exit_status(status);
         }
     }
     return wpid == 0;
 }
 
 void bfutils_process_close(BFUtilsProcess *p) {
-    close(p->stdin_fd);
-    close(p->stdout_fd);
-    close(p->stderr_fd);
+    if (p->stdin_fd >= 0) close(p->stdin_fd);
+    if (p->stdout_fd >= 0) close(p->stdout_fd);
+    if (p->stderr_fd >= 0) close(p->stderr_fd);
+    if (p->pid_fd_owned) close(p->pid_fd);
+    p->pid_fd = -1;
+    p->pid_fd_owned = 0;
+    p->stdin_fd = -1;
+    p->stdout_fd = -1;
+    p->stderr_fd = -1;
 }
 #endif //BFUTILS_PROCESS_IMPLEMENTATION
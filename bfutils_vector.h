@@ -38,10 +38,67 @@ USAGE:
         vector_pop:
             T vector_pop(T*); Removes and return the last element in the vector.
 
+        vector_insert:
+            void vector_insert(T*, size_t, T); Inserts an element at the provided index, shifting the following elements. Grows the vector if required.
+
+        vector_insert_n:
+            void vector_insert_n(T*, size_t, const T*, size_t); Inserts n elements copied from the provided array at the provided index.
+
+        vector_erase_range:
+            void vector_erase_range(T*, size_t, size_t); Removes the elements in the range [start, end), shifting the following elements with a single memmove.
+            Nothing is removed if end is not greater than start, and an end past the vector length removes up to the last element.
+            If an element_free function was provided during the vector initialization, it will be called for each removed element.
+
+        vector_swap_remove:
+            T vector_swap_remove(T*, size_t); Removes and returns the element at the provided index, moving the last element to its place.
+            If the index is out of range (e.g. the vector is empty), nothing is removed and a zeroed T is returned.
+            It runs in constant time, but it doesn't preserve the order of the elements.
+
+        vector_splice:
+            void vector_splice(T*, size_t, size_t, const T*, size_t); Replaces "count" elements starting at "start" by n elements copied from the provided array.
+            vector_splice(v, start, count, src, n). The elements after the range are moved only once.
+            If an element_free function was provided during the vector initialization, it will be called for each replaced element.
+            The provided array must not point to the vector itself.
+
+        vector_reserve_exact:
+            void vector_reserve_exact(T*, size_t); Ensures the vector has room for exactly the provided number of additional elements, without the 1.5x growth slack.
+
+        vector_shrink_to_fit:
+            void vector_shrink_to_fit(T*); Reallocates the vector so its capacity is equal to its length, releasing the excess memory.
+
+        vector_truncate:
+            void vector_truncate(T*, size_t); Shortens the vector to the provided length, keeping its capacity.
+            If an element_free function was provided during the vector initialization, it will be called for each dropped element.
+            If the provided length is greater or equal than the vector length, nothing happens.
+
+        vector_clear:
+            void vector_clear(T*); Removes all elements of the vector, keeping its capacity. Same as vector_truncate(T*, 0).
+
+        vector_detach:
+            T *vector_detach(T*); Returns the vector and sets the variable to NULL, transferring the ownership of the buffer without copying it.
+            The returned vector needs to be free by calling vector_free.
+
         vector_free:
             void vector_free(T*); Frees the vector.
             If an element_free function was provided during the vector initialization, this function will be called for each element of the vector, passing a pointer to the element.
 
+        vector_write:
+            int vector_write(int, T*); Writes the vector to a file descriptor as a small header followed by its elements in a single contiguous block.
+            Returns 0 on success or -1 on error (errno is set).
+            The elements are written as they are in memory, so it must only be used with vectors of POD types and read on a machine with the same ABI.
+
+        vector_read:
+            void vector_read(int, T*); Reads a vector written by vector_write from a file descriptor and stores it on the provided variable.
+            On error, or if the element size doesn't match, the variable is set to NULL. The previous value of the variable is not freed.
+
+        vector_mmap:
+            void vector_mmap(const char*, T*); Maps a file written by vector_write to memory and stores a read-only vector backed by it on the provided variable.
+            No data is copied, and vector_length and index access work as usual. Any function that modifies the vector must not be used on it.
+            On error, or if the element size doesn't match, the variable is set to NULL.
+
+        vector_munmap:
+            void vector_munmap(T*); Unmaps a vector created by vector_mmap. It must be used instead of vector_free for these vectors.
+
         string_push:
             void string_push(char *, const char*); Appends to the end of a char* vector another char* vector.
             It inserts a NULL byte at the end without incrementing the length.
@@ -56,6 +113,83 @@ USAGE:
 
         string_format:
             char *string_format(const char*, ...); Returns the formatted string. It needs to be free by calling vector_free. 
+
+        string_push_format:
+            void string_push_format(char *, const char*, ...); Appends a formatted string to the end of a char* vector.
+            The string is formatted directly into the spare capacity of the vector, vsnprintf is called again only if it doesn't fit.
+            It inserts a NULL byte at the end without incrementing the length.
+
+        string_push_int:
+            void string_push_int(char *, long long); Appends the decimal representation of an integer to the end of a char* vector, without using printf.
+            It inserts a NULL byte at the end without incrementing the length.
+
+        string_push_uint:
+            void string_push_uint(char *, unsigned long long); Appends the decimal representation of an unsigned integer to the end of a char* vector, without using printf.
+            It inserts a NULL byte at the end without incrementing the length.
+
+        string_push_double:
+            void string_push_double(char *, double, int); Appends a double with the provided number of decimal places to the end of a char* vector, like "%.*f".
+            For precision up to 9 it's converted without using printf, with the same result.
+            Very large values and values close to a rounding tie are formatted with snprintf.
+            It inserts a NULL byte at the end without incrementing the length.
+
+        string_utf8_valid:
+            int string_utf8_valid(const char*, size_t); Returns a non-zero value if the first n bytes are valid UTF-8 (no overlong encodings, surrogates or code points above U+10FFFF).
+            ASCII runs are checked 32 bytes at a time.
+
+        string_utf8_length:
+            size_t string_utf8_length(const char*, size_t); Returns the number of code points in the first n bytes of a valid UTF-8 string.
+
+        string_utf8_to_utf32:
+            uint32_t *string_utf8_to_utf32(const char*, size_t); Returns a uint32_t vector with the code points of the first n bytes of a UTF-8 string.
+            Returns NULL if the input is not valid UTF-8. It needs to be free by calling vector_free.
+
+        string_utf8_to_utf16:
+            uint16_t *string_utf8_to_utf16(const char*, size_t); Returns a uint16_t vector with the UTF-16 encoding of the first n bytes of a UTF-8 string.
+            Returns NULL if the input is not valid UTF-8. It needs to be free by calling vector_free.
+
+        string_utf32_to_utf8:
+            char *string_utf32_to_utf8(const uint32_t*, size_t); Returns a char* vector with the UTF-8 encoding of n code points.
+            Returns NULL if a code point is a surrogate or is above U+10FFFF. It needs to be free by calling vector_free.
+
+        string_utf16_to_utf8:
+            char *string_utf16_to_utf8(const uint16_t*, size_t); Returns a char* vector with the UTF-8 encoding of n UTF-16 code units.
+            Returns NULL if there is an unpaired surrogate. It needs to be free by calling vector_free.
+
+        string_ascii_lower:
+            void string_ascii_lower(char*, size_t); Converts the ASCII letters of the first n bytes to lower case, in place. Other bytes are not changed.
+
+        string_ascii_upper:
+            void string_ascii_upper(char*, size_t); Converts the ASCII letters of the first n bytes to upper case, in place. Other bytes are not changed.
+
+        string_builder:
+            StringBuilder string_builder(size_t); Creates a string builder that stores the text in a list of fixed-size chunks.
+            Appending never moves the text already written, so it's suited for very large outputs. If the chunk size is 0, 64KB is used.
+
+        string_builder_append:
+            void string_builder_append(StringBuilder*, const char*, size_t); Appends n bytes to the string builder.
+
+        string_builder_append_cstr:
+            void string_builder_append_cstr(StringBuilder*, const char*); Appends a null terminated string to the string builder.
+
+        string_builder_appendf:
+            void string_builder_appendf(StringBuilder*, const char*, ...); Appends a formatted string to the string builder.
+
+        string_builder_length:
+            size_t string_builder_length(StringBuilder*); Returns the number of bytes in the string builder.
+
+        string_builder_flush:
+            int string_builder_flush(StringBuilder*, int); Writes the contents of the string builder to a file descriptor using writev and clears it.
+            Returns 0 on success or -1 on error (errno is set). On error, the bytes not written are kept in the string builder.
+
+        string_builder_to_string:
+            char *string_builder_to_string(StringBuilder*); Returns a char* vector with the contents of the string builder. It needs to be free by calling vector_free.
+
+        string_builder_clear:
+            void string_builder_clear(StringBuilder*); Removes the contents of the string builder, keeping one chunk to be reused.
+
+        string_builder_free:
+            void string_builder_free(StringBuilder*); Frees the string builder.
     
     Compile-time options:
         
@@ -109,11 +243,46 @@ LICENSE:
 #define vector_ensure_capacity bfutils_vector_ensure_capacity
 #define vector_push bfutils_vector_push
 #define vector_pop bfutils_vector_pop
+#define vector_insert bfutils_vector_insert
+#define vector_insert_n bfutils_vector_insert_n
+#define vector_erase_range bfutils_vector_erase_range
+#define vector_swap_remove bfutils_vector_swap_remove
+#define vector_splice bfutils_vector_splice
+#define vector_reserve_exact bfutils_vector_reserve_exact
+#define vector_shrink_to_fit bfutils_vector_shrink_to_fit
+#define vector_truncate bfutils_vector_truncate
+#define vector_clear bfutils_vector_clear
+#define vector_detach bfutils_vector_detach
 #define vector_free bfutils_vector_free
+#define vector_write bfutils_vector_write
+#define vector_read bfutils_vector_read
+#define vector_mmap bfutils_vector_mmap
+#define vector_munmap bfutils_vector_munmap
 #define string_push bfutils_string_push_str
 #define string_push_cstr bfutils_string_push_cstr
 #define string_split bfutils_string_split
 #define string_format bfutils_string_format
+#define string_push_format bfutils_string_push_format
+#define string_push_int bfutils_string_push_int
+#define string_push_uint bfutils_string_push_uint
+#define string_push_double bfutils_string_push_double
+#define string_utf8_valid bfutils_string_utf8_valid
+#define string_utf8_length bfutils_string_utf8_length
+#define string_utf8_to_utf32 bfutils_string_utf8_to_utf32
+#define string_utf8_to_utf16 bfutils_string_utf8_to_utf16
+#define string_utf32_to_utf8 bfutils_string_utf32_to_utf8
+#define string_utf16_to_utf8 bfutils_string_utf16_to_utf8
+#define string_ascii_lower bfutils_string_ascii_lower
+#define string_ascii_upper bfutils_string_ascii_upper
+#define string_builder bfutils_string_builder
+#define string_builder_append bfutils_string_builder_append
+#define string_builder_append_cstr bfutils_string_builder_append_cstr
+#define string_builder_appendf bfutils_string_builder_appendf
+#define string_builder_length bfutils_string_builder_length
+#define string_builder_flush bfutils_string_builder_flush
+#define string_builder_to_string bfutils_string_builder_to_string
+#define string_builder_clear bfutils_string_builder_clear
+#define string_builder_free bfutils_string_builder_free
 
 #endif //BFUTILS_VECTOR_NO_SHORT_NAME
 
@@ -128,6 +297,8 @@ LICENSE:
 #endif //BFUTILS_REALLOC
 
 #include <stddef.h>
+#include <stdarg.h>
+#include <stdint.h>
 
 typedef struct {
     size_t length;
@@ -135,6 +306,16 @@ typedef struct {
     void (*element_free)(void*);
 } BFUtilsVectorHeader;
 
+typedef struct {
+    char **chunks; // vector of char* vectors, each with capacity chunk_size + 1
+    size_t chunk_size;
+    size_t length;
+} BFUtilsStringBuilder;
+
+#ifndef BFUTILS_VECTOR_NO_SHORT_NAME
+typedef BFUtilsStringBuilder StringBuilder;
+#endif //BFUTILS_VECTOR_NO_SHORT_NAME
+
 #define bfutils_vector_header(v) ((v) ? (BFUtilsVectorHeader *) (v) - 1 : NULL)
 #define bfutils_vector_capacity(v) ((v) ? bfutils_vector_header((v))->capacity : 0)
 #define bfutils_vector_element_free(v) ((v) ? bfutils_vector_header((v))->element_free : NULL)
@@ -143,11 +324,36 @@ typedef struct {
 #define bfutils_vector_push(v, e) ((v) = bfutils_vector_grow((v), sizeof(*(v)), bfutils_vector_length((v)) + 1),\
     (v)[bfutils_vector_header((v))->length++] = e)
 #define bfutils_vector_pop(v) ((v)[--bfutils_vector_header((v))->length])
+#define bfutils_vector_insert(v, i, e) ((v) = bfutils_vector_splice_f((v), sizeof(*(v)), (i), 0, (typeof(*(v))[1]){e}, 1))
+#define bfutils_vector_insert_n(v, i, a, n) ((v) = bfutils_vector_splice_f((v), sizeof(*(v)), (i), 0, (a), (n)))
+#define bfutils_vector_erase_range(v, s, e) ((v) = bfutils_vector_splice_f((v), sizeof(*(v)), (s), (size_t) (e) > (size_t) (s) ? (size_t) (e) - (size_t) (s) : 0, NULL, 0))
+#define bfutils_vector_swap_remove(v, i) ((size_t) (i) < bfutils_vector_length((v)) ?\
+    (bfutils_vector_swap_f((v), sizeof(*(v)), (i), bfutils_vector_length((v)) - 1), bfutils_vector_pop(v)) : (typeof(*(v))){0})
+#define bfutils_vector_splice(v, s, c, a, n) ((v) = bfutils_vector_splice_f((v), sizeof(*(v)), (s), (c), (a), (n)))
 #define bfutils_vector_free(v) (bfutils_vector_free_func(v, sizeof(*(v))), (v) = NULL)
 #define bfutils_vector_ensure_capacity(v, c) ((v) = bfutils_vector_capacity_grow((v), sizeof(*(v)), (c)))
+#define bfutils_vector_reserve_exact(v, n) ((v) = bfutils_vector_capacity_grow((v), sizeof(*(v)), bfutils_vector_length((v)) + (n)))
+#define bfutils_vector_shrink_to_fit(v) ((v) = bfutils_vector_shrink_f((v), sizeof(*(v))))
+#define bfutils_vector_truncate(v, l) (bfutils_vector_truncate_f((v), sizeof(*(v)), (l)))
+#define bfutils_vector_clear(v) (bfutils_vector_truncate_f((v), sizeof(*(v)), 0))
+#define bfutils_vector_detach(v) ((typeof(v)) bfutils_vector_detach_f((void**) &(v)))
 #define bfutils_string_push_cstr(s, a) ((s) = bfutils_string_push_cstr_f((s), (a)))
 #define bfutils_string_push_str(s, a) ((s) = bfutils_string_push_str_f((s), (a)))
+#define bfutils_string_push_format(s, ...) ((s) = bfutils_string_push_format_f((s), __VA_ARGS__))
+#define bfutils_string_push_int(s, n) ((s) = bfutils_string_push_int_f((s), (n)))
+#define bfutils_string_push_uint(s, n) ((s) = bfutils_string_push_uint_f((s), (n)))
+#define bfutils_string_push_double(s, d, p) ((s) = bfutils_string_push_double_f((s), (d), (p)))
 #define bfutils_vector(element_free) (bfutils_vector_with_free((element_free)))
+#define bfutils_string_builder_length(sb) ((sb)->length)
+#define bfutils_vector_write(fd, v) (bfutils_vector_write_f((fd), (v), sizeof(*(v))))
+#define bfutils_vector_read(fd, v) ((v) = bfutils_vector_read_f((fd), sizeof(*(v))))
+#define bfutils_vector_mmap(path, v) ((v) = bfutils_vector_mmap_f((path), sizeof(*(v))))
+#define bfutils_vector_munmap(v) (bfutils_vector_munmap_f((v)), (v) = NULL)
+
+// Size of the header written by vector_write. The BFUtilsVectorHeader is stored at its end, right before the elements,
+// so a mapped file can be used as a vector without copying.
+#define BFUTILS_VECTOR_FILE_HEADER_SIZE 64
+#define BFUTILS_VECTOR_FILE_MAGIC "BFUVEC1"
 
 #define BFUTILS_VECTOR_FREE_WRAPPER(name, T, f) void name(void *addr) {\
     T *element_addr = (T*) addr; \
@@ -158,17 +364,53 @@ typedef struct {
 extern void *bfutils_vector_with_free(void (*element_free)(void*));
 extern void *bfutils_vector_grow(void *vector, size_t element_size, size_t length);
 extern void *bfutils_vector_capacity_grow(void *vector, size_t element_size, size_t capacity);
+extern void *bfutils_vector_splice_f(void *vector, size_t element_size, size_t start, size_t count, const void *src, size_t n);
+extern void bfutils_vector_swap_f(void *vector, size_t element_size, size_t i, size_t j);
+extern void *bfutils_vector_shrink_f(void *vector, size_t element_size);
+extern void bfutils_vector_truncate_f(void *vector, size_t element_size, size_t length);
+extern void *bfutils_vector_detach_f(void **vector);
 extern char* bfutils_string_push_cstr_f(char *str, const char *cstr);
 extern char* bfutils_string_push_str_f(char *str, const char *s);
 extern char** bfutils_string_split(const char *cstr, const char *delim);
 extern char* bfutils_string_format(const char *format, ...);
+extern char* bfutils_string_push_format_f(char *str, const char *format, ...);
+extern char* bfutils_string_push_vformat_f(char *str, const char *format, va_list list);
+extern char* bfutils_string_push_int_f(char *str, long long n);
+extern char* bfutils_string_push_uint_f(char *str, unsigned long long n);
+extern char* bfutils_string_push_double_f(char *str, double d, int precision);
+extern int bfutils_string_utf8_valid(const char *str, size_t n);
+extern size_t bfutils_string_utf8_length(const char *str, size_t n);
+extern uint32_t* bfutils_string_utf8_to_utf32(const char *str, size_t n);
+extern uint16_t* bfutils_string_utf8_to_utf16(const char *str, size_t n);
+extern char* bfutils_string_utf32_to_utf8(const uint32_t *str, size_t n);
+extern char* bfutils_string_utf16_to_utf8(const uint16_t *str, size_t n);
+extern void bfutils_string_ascii_lower(char *str, size_t n);
+extern void bfutils_string_ascii_upper(char *str, size_t n);
+extern BFUtilsStringBuilder bfutils_string_builder(size_t chunk_size);
+extern void bfutils_string_builder_append(BFUtilsStringBuilder *sb, const char *str, size_t n);
+extern void bfutils_string_builder_append_cstr(BFUtilsStringBuilder *sb, const char *str);
+extern void bfutils_string_builder_appendf(BFUtilsStringBuilder *sb, const char *format, ...);
+extern int bfutils_string_builder_flush(BFUtilsStringBuilder *sb, int fd);
+extern char* bfutils_string_builder_to_string(BFUtilsStringBuilder *sb);
+extern void bfutils_string_builder_clear(BFUtilsStringBuilder *sb);
+extern void bfutils_string_builder_free(BFUtilsStringBuilder *sb);
 extern void bfutils_vector_free_func(void *vector, size_t element_size);
+extern int bfutils_vector_write_f(int fd, const void *vector, size_t element_size);
+extern void *bfutils_vector_read_f(int fd, size_t element_size);
+extern void *bfutils_vector_mmap_f(const char *path, size_t element_size);
+extern void bfutils_vector_munmap_f(void *vector);
 
 #endif // VECTOR_H
 #ifdef BFUTILS_VECTOR_IMPLEMENTATION
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 void bfutils_vector_free_func(void *vector, size_t element_size) {
     if (vector == NULL) return;
@@ -217,24 +459,207 @@ void *bfutils_vector_capacity_grow(void *vector, size_t element_size, size_t cap
     return vector;
 }
 
+void *bfutils_vector_splice_f(void *vector, size_t element_size, size_t start, size_t count, const void *src, size_t n) {
+    size_t length = bfutils_vector_length(vector);
+    if (start > length) start = length;
+    if (count > length - start) count = length - start;
+
+    if (bfutils_vector_element_free(vector) != NULL) {
+        for(size_t i = start; i < start + count; i++) {
+            bfutils_vector_element_free(vector)((unsigned char*) vector + (element_size * i));
+        }
+    }
+
+    size_t new_length = length - count + n;
+    if (bfutils_vector_capacity(vector) < new_length) {
+        size_t capacity = bfutils_vector_new_capacity(vector);
+        vector = bfutils_vector_capacity_grow(vector, element_size, capacity > new_length ? capacity : new_length);
+    }
+    if (vector == NULL) return vector;
+
+    unsigned char *base = (unsigned char*) vector;
+    if (count != n && start + count < length) {
+        memmove(base + (element_size * (start + n)), base + (element_size * (start + count)), element_size * (length - start - count));
+    }
+    if (src != NULL && n > 0) {
+        memcpy(base + (element_size * start), src, element_size * n);
+    }
+    bfutils_vector_header(vector)->length = new_length;
+    return vector;
+}
+
+void bfutils_vector_swap_f(void *vector, size_t element_size, size_t i, size_t j) {
+    if (i == j) return;
+    unsigned char *a = (unsigned char*) vector + (element_size * i);
+    unsigned char *b = (unsigned char*) vector + (element_size * j);
+    for (size_t k = 0; k < element_size; k++) {
+        unsigned char t = a[k];
+        a[k] = b[k];
+        b[k] = t;
+    }
+}
+
+void *bfutils_vector_shrink_f(void *vector, size_t element_size) {
+    if (vector == NULL || bfutils_vector_capacity(vector) == bfutils_vector_length(vector)) {
+        return vector;
+    }
+    size_t length = bfutils_vector_length(vector);
+    BFUtilsVectorHeader *header = BFUTILS_REALLOC(bfutils_vector_header(vector), sizeof(BFUtilsVectorHeader) + (element_size * length));
+    header->capacity = length;
+    return (void*)(header + 1);
+}
+
+void bfutils_vector_truncate_f(void *vector, size_t element_size, size_t length) {
+    if (length >= bfutils_vector_length(vector)) return;
+
+    if (bfutils_vector_element_free(vector) != NULL) {
+        for(size_t i = length; i < bfutils_vector_length(vector); i++) {
+            bfutils_vector_element_free(vector)((unsigned char*) vector + (element_size * i));
+        }
+    }
+    bfutils_vector_header(vector)->length = length;
+}
+
+void *bfutils_vector_detach_f(void **vector) {
+    void *res = *vector;
+    *vector = NULL;
+    return res;
+}
+
+typedef struct {
+    char magic[8];
+    uint64_t element_size;
+    unsigned char reserved[BFUTILS_VECTOR_FILE_HEADER_SIZE - 16 - sizeof(BFUtilsVectorHeader)];
+    BFUtilsVectorHeader header;
+} BFUtilsVectorFileHeader;
+
+static int bfutils_vector_write_all(int fd, const void *buffer, size_t size) {
+    const unsigned char *p = (const unsigned char*) buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int bfutils_vector_read_all(int fd, void *buffer, size_t size) {
+    unsigned char *p = (unsigned char*) buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = EIO;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Checks the header and that its elements fit in available bytes without overflowing a size_t.
+static int bfutils_vector_file_header_valid(const BFUtilsVectorFileHeader *file_header, size_t element_size, size_t available) {
+    if (memcmp(file_header->magic, BFUTILS_VECTOR_FILE_MAGIC, sizeof(BFUTILS_VECTOR_FILE_MAGIC)) != 0 || file_header->element_size != element_size
+            || (element_size > 0 && file_header->header.length > (SIZE_MAX - sizeof(BFUtilsVectorHeader)) / element_size)
+            || file_header->header.length * element_size > available) {
+        errno = EINVAL;
+        return 0;
+    }
+    return 1;
+}
+
+int bfutils_vector_write_f(int fd, const void *vector, size_t element_size) {
+    BFUtilsVectorFileHeader file_header = {0};
+    memcpy(file_header.magic, BFUTILS_VECTOR_FILE_MAGIC, sizeof(BFUTILS_VECTOR_FILE_MAGIC));
+    file_header.element_size = element_size;
+    file_header.header.length = bfutils_vector_length(vector);
+    file_header.header.capacity = bfutils_vector_length(vector);
+    file_header.header.element_free = NULL;
+    if (bfutils_vector_write_all(fd, &file_header, sizeof(file_header)) < 0) {
+        return -1;
+    }
+    return bfutils_vector_write_all(fd, vector, element_size * bfutils_vector_length(vector));
+}
+
+void *bfutils_vector_read_f(int fd, size_t element_size) {
+    BFUtilsVectorFileHeader file_header;
+    if (bfutils_vector_read_all(fd, &file_header, sizeof(file_header)) < 0) {
+        return NULL;
+    }
+    // For regular files the length is checked against the file size, so a corrupt header can't allocate more than the file has.
+    size_t available = SIZE_MAX;
+    struct stat st;
+    off_t offset;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (offset = lseek(fd, 0, SEEK_CUR)) >= 0) {
+        available = st.st_size > offset ? (size_t) (st.st_size - offset) : 0;
+    }
+    if (!bfutils_vector_file_header_valid(&file_header, element_size, available)) {
+        return NULL;
+    }
+    size_t length = file_header.header.length;
+    BFUtilsVectorHeader *header = BFUTILS_REALLOC(NULL, sizeof(BFUtilsVectorHeader) + (element_size * length));
+    if (header == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    header->capacity = length;
+    header->length = 0;
+    header->element_free = NULL;
+    void *vector = (void*)(header + 1);
+    if (bfutils_vector_read_all(fd, vector, element_size * length) < 0) {
+        BFUTILS_FREE(header);
+        return NULL;
+    }
+    header->length = length;
+    return vector;
+}
+
+void *bfutils_vector_mmap_f(const char *path, size_t element_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    // The header is validated before mapping, so the mapping is read-only and only covers the header and the elements.
+    BFUtilsVectorFileHeader file_header;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(file_header) || bfutils_vector_read_all(fd, &file_header, sizeof(file_header)) < 0
+            || !bfutils_vector_file_header_valid(&file_header, element_size, st.st_size - sizeof(file_header)) || file_header.header.element_free != NULL) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void *addr = mmap(NULL, sizeof(file_header) + file_header.header.length * element_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    return (void*)((BFUtilsVectorFileHeader*) addr + 1);
+}
+
+void bfutils_vector_munmap_f(void *vector) {
+    if (vector == NULL) return;
+    BFUtilsVectorFileHeader *file_header = (BFUtilsVectorFileHeader*) vector - 1;
+    munmap(file_header, sizeof(*file_header) + file_header->header.length * file_header->element_size);
+}
+
+static char *bfutils_string_push_bytes(char *str, const char *bytes, size_t n);
+
 char *bfutils_string_push_cstr_f(char *str, const char *cstr) {
     if (cstr == NULL) 
         return str;
-    bfutils_vector_ensure_capacity(str, vector_length(str) + strlen(cstr) + 1);
-    for (size_t i = 0; i < strlen(cstr); i++) {
-        bfutils_vector_push(str, cstr[i]);
-    }
-    str[bfutils_vector_length(str)] = '\0'; //Inserts \0 without incrementing length
-    return str;
+    return bfutils_string_push_bytes(str, cstr, strlen(cstr));
 }
 
 char *bfutils_string_push_str_f(char *str, const char *s) {
-    bfutils_vector_ensure_capacity(str, vector_length(str) + vector_length(s) + 1);
-    for (size_t i = 0; i < bfutils_vector_length(s); i++) {
-        bfutils_vector_push(str, s[i]);
-    }
-    str[bfutils_vector_length(str)] = '\0'; //Inserts \0 without incrementing length
-    return str;
+    return bfutils_string_push_bytes(str, s, bfutils_vector_length(s));
 }
 
 char **bfutils_string_split(const char *cstr, const char *delim) {
@@ -257,17 +682,514 @@ char **bfutils_string_split(const char *cstr, const char *delim) {
 }
 
 char* bfutils_string_format(const char *format, ...) {
-    char *res = NULL;
     va_list list;
     va_start(list, format);
-    int l = vsnprintf(res, 0, format, list);
-    bfutils_vector_ensure_capacity(res, l + 1);
+    char *res = bfutils_string_push_vformat_f(NULL, format, list);
+    va_end(list);
+    return res;
+}
+
+char* bfutils_string_push_format_f(char *str, const char *format, ...) {
+    va_list list;
+    va_start(list, format);
+    str = bfutils_string_push_vformat_f(str, format, list);
+    va_end(list);
+    return str;
+}
+
+char* bfutils_string_push_vformat_f(char *str, const char *format, va_list list) {
+    size_t length = bfutils_vector_length(str);
+    str = bfutils_vector_grow(str, sizeof(char), length + 1);
+    size_t available = bfutils_vector_capacity(str) - length;
+
+    va_list copy;
+    va_copy(copy, list);
+    int l = vsnprintf(str + length, available, format, copy);
+    va_end(copy);
+    if (l < 0) {
+        str[length] = '\0';
+        return str;
+    }
+    if ((size_t) l >= available) {
+        size_t capacity = bfutils_vector_new_capacity(str);
+        str = bfutils_vector_capacity_grow(str, sizeof(char), capacity > length + l + 1 ? capacity : length + l + 1);
+        vsnprintf(str + length, l + 1, format, list);
+    }
+    bfutils_vector_header(str)->length = length + l;
+    return str;
+}
+
+static const char bfutils_string_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Writes the digits of n backwards, ending at end. Returns a pointer to the first digit.
+static char *bfutils_string_write_digits(char *end, unsigned long long n) {
+    while (n >= 100) {
+        size_t pair = (n % 100) * 2;
+        n /= 100;
+        *--end = bfutils_string_digit_pairs[pair + 1];
+        *--end = bfutils_string_digit_pairs[pair];
+    }
+    if (n >= 10) {
+        *--end = bfutils_string_digit_pairs[n * 2 + 1];
+        *--end = bfutils_string_digit_pairs[n * 2];
+    }
+    else {
+        *--end = (char) ('0' + n);
+    }
+    return end;
+}
+
+static char *bfutils_string_push_bytes(char *str, const char *bytes, size_t n) {
+    size_t length = bfutils_vector_length(str);
+    if (bfutils_vector_capacity(str) - length <= n) {
+        size_t capacity = bfutils_vector_new_capacity(str);
+        str = bfutils_vector_capacity_grow(str, sizeof(char), capacity > length + n + 1 ? capacity : length + n + 1);
+    }
+    memcpy(str + length, bytes, n);
+    bfutils_vector_header(str)->length = length + n;
+    str[length + n] = '\0'; //Inserts \0 without incrementing length
+    return str;
+}
+
+char* bfutils_string_push_uint_f(char *str, unsigned long long n) {
+    char buffer[24];
+    char *begin = bfutils_string_write_digits(buffer + sizeof(buffer), n);
+    return bfutils_string_push_bytes(str, begin, buffer + sizeof(buffer) - begin);
+}
+
+char* bfutils_string_push_int_f(char *str, long long n) {
+    char buffer[24];
+    unsigned long long u = n < 0 ? 0ULL - (unsigned long long) n : (unsigned long long) n;
+    char *begin = bfutils_string_write_digits(buffer + sizeof(buffer), u);
+    if (n < 0) {
+        *--begin = '-';
+    }
+    return bfutils_string_push_bytes(str, begin, buffer + sizeof(buffer) - begin);
+}
+
+char* bfutils_string_push_double_f(char *str, double d, int precision) {
+    static const unsigned long long pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    double magnitude = d < 0 ? -d : d;
+    if (precision < 0 || precision > 9 || !(magnitude < 1e18 / pow10[precision])) { // also catches NaN and infinity
+        return bfutils_string_push_format_f(str, "%.*f", precision, d);
+    }
+    double product = magnitude * pow10[precision];
+    unsigned long long scaled = (unsigned long long) product;
+    double fraction = product - (double) scaled;
+    // The product may be off by half an ulp, so values too close to a rounding tie are left to snprintf to be rounded exactly.
+    double distance = fraction > 0.5 ? fraction - 0.5 : 0.5 - fraction;
+    if (distance <= product * 2.3e-16) {
+        return bfutils_string_push_format_f(str, "%.*f", precision, d);
+    }
+    if (fraction > 0.5) {
+        scaled++;
+    }
+    char buffer[32];
+    char *end = buffer + sizeof(buffer);
+    char *begin = end;
+    if (precision > 0) {
+        begin = bfutils_string_write_digits(end, scaled % pow10[precision]);
+        while (end - begin < precision) {
+            *--begin = '0';
+        }
+        *--begin = '.';
+    }
+    begin = bfutils_string_write_digits(begin, scaled / pow10[precision]);
+    if (d < 0 || (d == 0 && 1 / d < 0)) {
+        *--begin = '-';
+    }
+    return bfutils_string_push_bytes(str, begin, end - begin);
+}
+
+typedef uint64_t BFUtilsStringWords __attribute__((vector_size(32)));
+typedef unsigned char BFUtilsStringBytes __attribute__((vector_size(32)));
+
+// Returns the number of bytes at the beginning of str that are ASCII, checking 32 bytes at a time.
+static size_t bfutils_string_ascii_prefix(const unsigned char *str, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        BFUtilsStringWords words;
+        memcpy(&words, str + i, sizeof(words));
+        if (((words[0] | words[1] | words[2] | words[3]) & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+    }
+    while (i < n && str[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Decodes one code point from a sequence of at least one byte. Returns -1 if the sequence is invalid, otherwise stores its size in *size.
+static long bfutils_string_utf8_decode(const unsigned char *str, size_t n, size_t *size) {
+    unsigned char c = str[0];
+    if (c < 0x80) {
+        *size = 1;
+        return c;
+    }
+    size_t len;
+    long cp;
+    long min;
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+        cp = c & 0x1F;
+        min = 0x80;
+    }
+    else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        cp = c & 0x0F;
+        min = 0x800;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        cp = c & 0x07;
+        min = 0x10000;
+    }
+    else {
+        return -1;
+    }
+    if (n < len) {
+        return -1;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if ((str[i] & 0xC0) != 0x80) {
+            return -1;
+        }
+        cp = (cp << 6) | (str[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return -1;
+    }
+    *size = len;
+    return cp;
+}
+
+int bfutils_string_utf8_valid(const char *str, size_t n) {
+    const unsigned char *s = (const unsigned char*) str;
+    size_t i = 0;
+    while (i < n) {
+        i += bfutils_string_ascii_prefix(s + i, n - i);
+        if (i == n) break;
+        size_t size;
+        if (bfutils_string_utf8_decode(s + i, n - i, &size) < 0) {
+            return 0;
+        }
+        i += size;
+    }
+    return 1;
+}
+
+size_t bfutils_string_utf8_length(const char *str, size_t n) {
+    const unsigned char *s = (const unsigned char*) str;
+    size_t count = 0;
+    size_t i = 0;
+    // Every byte that is not a continuation byte (10xxxxxx) starts a code point.
+    // Continuation bytes are counted 8 at a time in the byte lanes of a word, which are summed every 255 words, before they can overflow.
+    while (i + 8 <= n) {
+        size_t start = i;
+        uint64_t lanes = 0;
+        for (int block = 0; block < 255 && i + 8 <= n; block++, i += 8) {
+            uint64_t word;
+            memcpy(&word, s + i, sizeof(word));
+            lanes += ((word & ~(word << 1)) >> 7) & 0x0101010101010101ULL;
+        }
+        lanes = (lanes & 0x00FF00FF00FF00FFULL) + ((lanes >> 8) & 0x00FF00FF00FF00FFULL);
+        count += (i - start) - (size_t) ((lanes * 0x0001000100010001ULL) >> 48);
+    }
+    for (; i < n; i++) {
+        count += (s[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+uint32_t* bfutils_string_utf8_to_utf32(const char *str, size_t n) {
+    const unsigned char *s = (const unsigned char*) str;
+    uint32_t *res = bfutils_vector_with_free(NULL);
+    res = bfutils_vector_capacity_grow(res, sizeof(uint32_t), n + 1);
+    size_t length = 0;
+    size_t i = 0;
+    while (i < n) {
+        size_t ascii = bfutils_string_ascii_prefix(s + i, n - i);
+        for (size_t j = 0; j < ascii; j++) {
+            res[length++] = s[i + j];
+        }
+        i += ascii;
+        if (i == n) break;
+        size_t size;
+        long cp = bfutils_string_utf8_decode(s + i, n - i, &size);
+        if (cp < 0) {
+            BFUTILS_FREE(bfutils_vector_header(res));
+            return NULL;
+        }
+        res[length++] = (uint32_t) cp;
+        i += size;
+    }
+    bfutils_vector_header(res)->length = length;
+    return res;
+}
+
+uint16_t* bfutils_string_utf8_to_utf16(const char *str, size_t n) {
+    const unsigned char *s = (const unsigned char*) str;
+    uint16_t *res = bfutils_vector_with_free(NULL);
+    res = bfutils_vector_capacity_grow(res, sizeof(uint16_t), n + 1);
+    size_t length = 0;
+    size_t i = 0;
+    while (i < n) {
+        size_t ascii = bfutils_string_ascii_prefix(s + i, n - i);
+        for (size_t j = 0; j < ascii; j++) {
+            res[length++] = s[i + j];
+        }
+        i += ascii;
+        if (i == n) break;
+        size_t size;
+        long cp = bfutils_string_utf8_decode(s + i, n - i, &size);
+        if (cp < 0) {
+            BFUTILS_FREE(bfutils_vector_header(res));
+            return NULL;
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            res[length++] = (uint16_t) (0xD800 | (cp >> 10));
+            res[length++] = (uint16_t) (0xDC00 | (cp & 0x3FF));
+        }
+        else {
+            res[length++] = (uint16_t) cp;
+        }
+        i += size;
+    }
+    bfutils_vector_header(res)->length = length;
+    return res;
+}
+
+static size_t bfutils_string_utf8_encode(unsigned char *dst, uint32_t cp) {
+    if (cp < 0x80) {
+        dst[0] = (unsigned char) cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        dst[0] = (unsigned char) (0xC0 | (cp >> 6));
+        dst[1] = (unsigned char) (0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dst[0] = (unsigned char) (0xE0 | (cp >> 12));
+        dst[1] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+        dst[2] = (unsigned char) (0x80 | (cp & 0x3F));
+        return 3;
+    }
+    dst[0] = (unsigned char) (0xF0 | (cp >> 18));
+    dst[1] = (unsigned char) (0x80 | ((cp >> 12) & 0x3F));
+    dst[2] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+    dst[3] = (unsigned char) (0x80 | (cp & 0x3F));
+    return 4;
+}
+
+char* bfutils_string_utf32_to_utf8(const uint32_t *str, size_t n) {
+    char *res = bfutils_vector_with_free(NULL);
+    res = bfutils_vector_capacity_grow(res, sizeof(char), n * 4 + 1);
+    size_t length = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (str[i] > 0x10FFFF || (str[i] >= 0xD800 && str[i] <= 0xDFFF)) {
+            BFUTILS_FREE(bfutils_vector_header(res));
+            return NULL;
+        }
+        length += bfutils_string_utf8_encode((unsigned char*) res + length, str[i]);
+    }
+    res[length] = '\0'; //Inserts \0 without incrementing length
+    bfutils_vector_header(res)->length = length;
+    return res;
+}
+
+char* bfutils_string_utf16_to_utf8(const uint16_t *str, size_t n) {
+    char *res = bfutils_vector_with_free(NULL);
+    res = bfutils_vector_capacity_grow(res, sizeof(char), n * 3 + 1);
+    size_t length = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t cp = str[i];
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < n && str[i + 1] >= 0xDC00 && str[i + 1] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (str[i + 1] - 0xDC00);
+            i++;
+        }
+        else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            BFUTILS_FREE(bfutils_vector_header(res));
+            return NULL;
+        }
+        length += bfutils_string_utf8_encode((unsigned char*) res + length, cp);
+    }
+    res[length] = '\0'; //Inserts \0 without incrementing length
+    bfutils_vector_header(res)->length = length;
+    return res;
+}
+
+// Adds (or subtracts) 0x20 to the bytes between first and last, 32 bytes at a time.
+static void bfutils_string_ascii_case(char *str, size_t n, unsigned char first, unsigned char last, int lower) {
+    unsigned char *s = (unsigned char*) str;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        BFUtilsStringBytes bytes;
+        memcpy(&bytes, s + i, sizeof(bytes));
+        BFUtilsStringBytes in_range = (BFUtilsStringBytes) ((bytes >= first) & (bytes <= last));
+        bytes = lower ? bytes + (in_range & 0x20) : bytes - (in_range & 0x20);
+        memcpy(s + i, &bytes, sizeof(bytes));
+    }
+    for (; i < n; i++) {
+        if (s[i] >= first && s[i] <= last) {
+            s[i] = lower ? s[i] + 0x20 : s[i] - 0x20;
+        }
+    }
+}
+
+void bfutils_string_ascii_lower(char *str, size_t n) {
+    bfutils_string_ascii_case(str, n, 'A', 'Z', 1);
+}
+
+void bfutils_string_ascii_upper(char *str, size_t n) {
+    bfutils_string_ascii_case(str, n, 'a', 'z', 0);
+}
+
+BFUtilsStringBuilder bfutils_string_builder(size_t chunk_size) {
+    return (BFUtilsStringBuilder) {
+        .chunks = NULL,
+        .chunk_size = chunk_size > 0 ? chunk_size : 64 * 1024,
+        .length = 0,
+    };
+}
+
+// Returns the last chunk, adding a new one if it is full. Chunks have an extra byte so vsnprintf can write its \0.
+static char *bfutils_string_builder_tail(BFUtilsStringBuilder *sb) {
+    size_t count = bfutils_vector_length(sb->chunks);
+    if (count > 0 && bfutils_vector_length(sb->chunks[count - 1]) < sb->chunk_size) {
+        return sb->chunks[count - 1];
+    }
+    char *chunk = NULL;
+    bfutils_vector_ensure_capacity(chunk, sb->chunk_size + 1);
+    bfutils_vector_push(sb->chunks, chunk);
+    return chunk;
+}
+
+void bfutils_string_builder_append(BFUtilsStringBuilder *sb, const char *str, size_t n) {
+    sb->length += n;
+    while (n > 0) {
+        char *chunk = bfutils_string_builder_tail(sb);
+        size_t available = sb->chunk_size - bfutils_vector_length(chunk);
+        size_t count = n < available ? n : available;
+        memcpy(chunk + bfutils_vector_length(chunk), str, count);
+        bfutils_vector_header(chunk)->length += count;
+        str += count;
+        n -= count;
+    }
+}
+
+void bfutils_string_builder_append_cstr(BFUtilsStringBuilder *sb, const char *str) {
+    if (str == NULL) return;
+    bfutils_string_builder_append(sb, str, strlen(str));
+}
+
+void bfutils_string_builder_appendf(BFUtilsStringBuilder *sb, const char *format, ...) {
+    char *chunk = bfutils_string_builder_tail(sb);
+    size_t length = bfutils_vector_length(chunk);
+    size_t available = sb->chunk_size - length + 1;
+
+    va_list list;
+    va_start(list, format);
+    int l = vsnprintf(chunk + length, available, format, list);
     va_end(list);
+    if (l < 0) return;
+    if ((size_t) l < available) {
+        bfutils_vector_header(chunk)->length += l;
+        sb->length += l;
+        return;
+    }
 
+    // It doesn't fit on the last chunk, so it's formatted separately and split between chunks.
+    char *tmp = bfutils_vector_capacity_grow(NULL, sizeof(char), l + 1);
     va_start(list, format);
-    vsnprintf(res, l+1, format, list);
-    bfutils_vector_header(res)->length = l;
+    vsnprintf(tmp, l + 1, format, list);
     va_end(list);
+    bfutils_string_builder_append(sb, tmp, l);
+    BFUTILS_FREE(bfutils_vector_header(tmp));
+}
+
+int bfutils_string_builder_flush(BFUtilsStringBuilder *sb, int fd) {
+    size_t count = bfutils_vector_length(sb->chunks);
+    size_t first = 0;
+    size_t offset = 0;
+    struct iovec iov[64];
+    while (first < count) {
+        int iovcnt = 0;
+        for (size_t i = first; i < count && iovcnt < 64; i++) {
+            size_t skip = i == first ? offset : 0;
+            iov[iovcnt].iov_base = sb->chunks[i] + skip;
+            iov[iovcnt].iov_len = bfutils_vector_length(sb->chunks[i]) - skip;
+            iovcnt++;
+        }
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // Drops what was already written, so a new flush continues from where this one stopped.
+            for (size_t i = 0; i < first; i++) {
+                bfutils_vector_free(sb->chunks[i]);
+            }
+            bfutils_vector_splice(sb->chunks, 0, first, NULL, 0);
+            if (offset > 0) {
+                bfutils_vector_erase_range(sb->chunks[0], 0, offset);
+            }
+            sb->length = 0;
+            for (size_t i = 0; i < bfutils_vector_length(sb->chunks); i++) {
+                sb->length += bfutils_vector_length(sb->chunks[i]);
+            }
+            return -1;
+        }
+        size_t written = (size_t) n + offset;
+        while (first < count && written >= bfutils_vector_length(sb->chunks[first])) {
+            written -= bfutils_vector_length(sb->chunks[first]);
+            first++;
+        }
+        offset = written;
+    }
+    bfutils_string_builder_clear(sb);
+    return 0;
+}
+
+char* bfutils_string_builder_to_string(BFUtilsStringBuilder *sb) {
+    char *res = bfutils_vector_with_free(NULL);
+    res = bfutils_vector_capacity_grow(res, sizeof(char), sb->length + 1);
+    size_t length = 0;
+    for (size_t i = 0; i < bfutils_vector_length(sb->chunks); i++) {
+        memcpy(res + length, sb->chunks[i], bfutils_vector_length(sb->chunks[i]));
+        length += bfutils_vector_length(sb->chunks[i]);
+    }
+    res[length] = '\0'; //Inserts \0 without incrementing length
+    bfutils_vector_header(res)->length = length;
     return res;
 }
+
+void bfutils_string_builder_clear(BFUtilsStringBuilder *sb) {
+    for (size_t i = 1; i < bfutils_vector_length(sb->chunks); i++) {
+        bfutils_vector_free(sb->chunks[i]);
+    }
+    if (bfutils_vector_length(sb->chunks) > 0) {
+        bfutils_vector_header(sb->chunks)->length = 1;
+        bfutils_vector_header(sb->chunks[0])->length = 0;
+    }
+    sb->length = 0;
+}
+
+void bfutils_string_builder_free(BFUtilsStringBuilder *sb) {
+    for (size_t i = 0; i < bfutils_vector_length(sb->chunks); i++) {
+        bfutils_vector_free(sb->chunks[i]);
+    }
+    bfutils_vector_free(sb->chunks);
+    sb->length = 0;
+}
 #endif //BFUTILS_VECTOR_IMPLEMENTATION
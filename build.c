@@ -13,9 +13,15 @@ void bfutils_build([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
     
     bfutils_add_executable(
         .name = "test",
-        .ldflags = "-fprofile-arcs",
-        .cflags = "-fPIC -fprofile-arcs -ftest-coverage",
+        .ldflags = "-fprofile-arcs -pthread",
+        .cflags = "-fPIC -fprofile-arcs -ftest-coverage -pthread",
         .files = (char*[]) { "test.c" },
         .files_len = 1,
     );
+
+    bfutils_add_executable(
+        .name = "bench",
+        .files = (char*[]) { "bench.c" },
+        .files_len = 1,
+    );
 }
@@ -9,6 +9,12 @@
 #include "bfutils_hash.h"
 #define BFUTILS_PROCESS_IMPLEMENTATION
 #include "bfutils_process.h"
+#define BFUTILS_DEQUE_IMPLEMENTATION
+#include "bfutils_deque.h"
+#define BFUTILS_BITSET_IMPLEMENTATION
+#include "bfutils_bitset.h"
+#include <pthread.h>
+#include <sched.h>
 
 typedef struct {
     int key;
@@ -20,6 +26,8 @@ typedef struct {
     int value;
 } Node;
 
+BFUTILS_VECTOR_FREE_WRAPPER(free_matrix_element, int*, vector_free)
+
 void test_hash() {
     IntNode *map = NULL;
     hashmap_push(map, 8, 120);
@@ -88,11 +96,11 @@ void test_process() {
     char *out;
     char *err;
     
-    char **cmd = (char*[]){"file", "-i", "bfutils_process.h", NULL};
+    char **cmd = (char*[]){"file", "-i", "bfutils_test.h", NULL};
     int status = process_sync(cmd, NULL, &out, &err);
     assert(status == 0);
     assert(0 == strcmp("", err));
-    assert(0 == strcmp("bfutils_process.h: text/x-c; charset=utf-8\n", out));
+    assert(0 == strcmp("bfutils_test.h: text/x-c; charset=utf-8\n", out));
     free(out);
     free(err);
 
@@ -112,6 +120,463 @@ void test_process() {
     process_close(&p);
 }
 
+static void count_bytes(const char *data, size_t length, void *user_data) {
+    (void) data;
+    *(size_t*) user_data += length;
+}
+
+void test_process_communicate() {
+    size_t in_len = 4 * 1024 * 1024;
+    char *in = malloc(in_len + 1);
+    memset(in, 'a', in_len);
+    in[in_len] = '\0';
+
+    // Both directions are larger than a pipe buffer, so writing everything before reading would deadlock.
+    char *out;
+    char *err;
+    int status = process_sync((char*[]){"cat", NULL}, in, &out, &err);
+    assert(status == 0);
+    assert(in_len == strlen(out));
+    assert(0 == strcmp("", err));
+    free(out);
+    free(err);
+
+    Process p = process_async((char*[]){"cat", NULL});
+    size_t count = 0;
+    assert(0 == process_communicate(&p, in, in_len, count_bytes, NULL, &count));
+    assert(0 == process_wait(&p));
+    assert(in_len == count);
+    process_close(&p);
+
+    p = process_async((char*[]){"true", NULL});
+    assert(0 == process_communicate(&p, in, in_len, NULL, NULL, NULL));
+    assert(0 == process_wait(&p));
+    process_close(&p);
+    free(in);
+}
+
+void test_process_binary_output() {
+    char *out;
+    size_t out_len;
+    int status = process_sync_n((char*[]){"cat", NULL}, "a\0b\0c", 5, &out, &out_len, NULL, NULL);
+    assert(status == 0);
+    assert(5 == out_len);
+    assert(0 == memcmp("a\0b\0c", out, 5));
+    free(out);
+
+    status = process_sync_n((char*[]){"head", "-c", "300000", "/dev/zero", NULL}, NULL, 0, &out, &out_len, NULL, NULL);
+    assert(status == 0);
+    assert(300000 == out_len);
+    free(out);
+
+    Process p = process_async((char*[]){"printf", "x\\0y", NULL});
+    process_wait(&p);
+    size_t length;
+    out = process_read_stdout_n(&p, &length);
+    assert(3 == length);
+    assert(0 == memcmp("x\0y", out, 3));
+    free(out);
+    process_close(&p);
+
+    p = process_async((char*[]){"echo", "vector", NULL});
+    process_wait(&p);
+    char *v = NULL;
+    string_push_cstr(v, "output: ");
+    process_read_stdout_vector(&p, v);
+    assert(0 == strcmp("output: vector\n", v));
+    assert(15 == vector_length(v));
+    vector_free(v);
+    process_close(&p);
+}
+
+static void count_job(ProcessJob *job, void *user_data) {
+    (void) job;
+    (*(int*) user_data)++;
+}
+
+void test_process_pool() {
+    ProcessJob jobs[20] = {0};
+    char names[20][8];
+    char *cmds[20][4];
+    for (int i = 0; i < 20; i++) {
+        snprintf(names[i], sizeof(names[i]), "job %d", i);
+        if (i % 3 == 0) {
+            cmds[i][0] = "cat";
+            cmds[i][1] = NULL;
+            jobs[i].in = names[i];
+            jobs[i].in_len = strlen(names[i]);
+        }
+        else if (i % 3 == 1) {
+            cmds[i][0] = "echo";
+            cmds[i][1] = "-n";
+            cmds[i][2] = names[i];
+            cmds[i][3] = NULL;
+        }
+        else {
+            cmds[i][0] = "sh";
+            cmds[i][1] = "-c";
+            cmds[i][2] = "echo -n err >&2; exit 3";
+            cmds[i][3] = NULL;
+        }
+        jobs[i].cmd = cmds[i];
+    }
+
+    int completed = 0;
+    assert(0 == process_pool_run(jobs, 20, 4, count_job, &completed));
+    assert(20 == completed);
+    for (int i = 0; i < 20; i++) {
+        if (i % 3 == 2) {
+            assert(3 == jobs[i].status);
+            assert(0 == jobs[i].out_len);
+            assert(0 == strcmp("err", jobs[i].err));
+        }
+        else {
+            assert(0 == jobs[i].status);
+            assert(strlen(names[i]) == jobs[i].out_len);
+            assert(0 == strcmp(names[i], jobs[i].out));
+        }
+        free(jobs[i].out);
+        free(jobs[i].err);
+    }
+
+    ProcessJob job = {.cmd = (char*[]){"true", NULL}};
+    assert(0 == process_pool_run(&job, 1, 0, NULL, NULL));
+    assert(0 == job.status);
+    free(job.out);
+    free(job.err);
+
+    job = (ProcessJob) {.cmd = (char*[]){"bfutils-command-not-found", NULL}};
+    assert(0 == process_pool_run(&job, 1, 1, NULL, NULL));
+    assert(-1 == job.status);
+
+    Process p = process_async((char*[]){"bfutils-command-not-found", NULL});
+    assert(-1 == p.pid);
+    assert(-1 == p.stdin_fd);
+    assert(-1 == p.stdout_fd);
+}
+
+void test_process_pipeline() {
+    size_t in_len = 4 * 1024 * 1024;
+    char *in = malloc(in_len);
+    memset(in, 'a', in_len);
+
+    ProcessPipeline pipeline = process_pipeline((char *const *const[]){
+        (char*[]){"cat", NULL},
+        (char*[]){"tr", "a", "b", NULL},
+        (char*[]){"sh", "-c", "cat; echo -n done >&2; exit 2", NULL},
+    }, 3);
+    assert(3 == pipeline.length);
+    size_t count = 0;
+    assert(0 == process_communicate(&pipeline.process, in, in_len, count_bytes, NULL, &count));
+    assert(in_len == count);
+    int statuses[3];
+    assert(2 == process_pipeline_wait(&pipeline, statuses));
+    assert(0 == statuses[0]);
+    assert(0 == statuses[1]);
+    assert(2 == statuses[2]);
+    process_pipeline_close(&pipeline);
+    free(in);
+
+    pipeline = process_pipeline((char *const *const[]){
+        (char*[]){"echo", "pipeline", NULL},
+        (char*[]){"tr", "a-z", "A-Z", NULL},
+    }, 2);
+    assert(0 == process_pipeline_wait(&pipeline, NULL));
+    char *out = process_read_stdout(&pipeline.process);
+    assert(0 == strcmp("PIPELINE\n", out));
+    free(out);
+    process_pipeline_close(&pipeline);
+
+    pipeline = process_pipeline((char *const *const[]){
+        (char*[]){"cat", NULL},
+        (char*[]){"bfutils-command-not-found", NULL},
+    }, 2);
+    assert(0 == pipeline.length);
+    assert(-1 == pipeline.process.pid);
+    process_pipeline_close(&pipeline);
+}
+
+void test_process_redirect() {
+    char in_path[] = "/tmp/bfutils_process_inXXXXXX";
+    char out_path[] = "/tmp/bfutils_process_outXXXXXX";
+    int in_fd = mkstemp(in_path);
+    int out_fd = mkstemp(out_path);
+    assert(in_fd >= 0);
+    assert(out_fd >= 0);
+    size_t in_len = 1024 * 1024;
+    char *in = malloc(in_len);
+    for (size_t i = 0; i < in_len; i++) {
+        in[i] = i % 251;
+    }
+    assert((ssize_t) in_len == write(in_fd, in, in_len));
+
+    Process p = process_async_with(.cmd = (char*[]){"cat", NULL}, .in = process_redirect_file(in_path), .out = process_redirect_fd(out_fd), .err = process_redirect_null());
+    assert(-1 == p.stdin_fd);
+    assert(-1 == p.stdout_fd);
+    assert(-1 == p.stderr_fd);
+    assert(0 == process_wait(&p));
+    process_close(&p);
+    char *out = malloc(in_len);
+    assert((ssize_t) in_len == pread(out_fd, out, in_len, 0));
+    assert(0 == memcmp(in, out, in_len));
+
+    p = process_async_with(.cmd = (char*[]){"sh", "-c", "echo err >&2", NULL}, .err = process_redirect_file(out_path));
+    assert(0 == process_wait(&p));
+    process_close(&p);
+    assert(4 == pread(out_fd, out, in_len, 0));
+    assert(0 == memcmp("err\n", out, 4));
+
+    p = process_async_with(.cmd = (char*[]){"wc", "-c", NULL}, .err = process_redirect_inherit());
+    lseek(in_fd, 0, SEEK_SET);
+    assert(0 == process_send_file(&p, in_fd));
+    assert(0 == process_wait(&p));
+    char *count = process_read_stdout(&p);
+    assert(in_len == strtoul(count, NULL, 10));
+    free(count);
+    process_close(&p);
+
+    p = process_async_with(.cmd = (char*[]){"cat", NULL}, .in = process_redirect_file("/bfutils/file/not/found"));
+    assert(-1 == p.pid);
+
+    free(in);
+    free(out);
+    close(in_fd);
+    close(out_fd);
+    unlink(in_path);
+    unlink(out_path);
+}
+
+void test_process_stdin_stream() {
+    size_t in_len = 1024 * 1024;
+    char *in = malloc(in_len + 1);
+    for (size_t i = 0; i < in_len; i++) {
+        in[i] = i % 251;
+    }
+    in[in_len] = '\0';
+    char *out = malloc(in_len);
+    size_t out_len = 0;
+
+    // Nothing reads cat's stdout yet, so both pipes fill and the writes stop without blocking.
+    Process p = process_async((char*[]){"cat", NULL});
+    size_t written = 0;
+    ssize_t n;
+    while ((n = process_write_stdin_n(&p, in + written, in_len - written)) > 0) {
+        written += n;
+    }
+    assert(0 == n);
+    assert(written > 0);
+    assert(written < in_len);
+
+    while (p.stdout_fd >= 0) {
+        struct pollfd fds[2] = {{.fd = p.stdout_fd, .events = POLLIN}, {.fd = p.stdin_fd, .events = POLLOUT}};
+        assert(poll(fds, p.stdin_fd >= 0 ? 2 : 1, -1) > 0);
+        if (fds[1].revents) {
+            size_t half = (in_len - written) / 2;
+            struct iovec iov[2] = {{in + written, half}, {in + written + half, in_len - written - half}};
+            n = process_writev_stdin(&p, iov, 2);
+            assert(n >= 0);
+            written += n;
+            if (written == in_len) {
+                close(p.stdin_fd);
+                p.stdin_fd = -1;
+            }
+        }
+        if (fds[0].revents) {
+            n = read(p.stdout_fd, out + out_len, in_len - out_len);
+            if (n == 0) {
+                close(p.stdout_fd);
+                p.stdout_fd = -1;
+            }
+            else if (n > 0) {
+                out_len += n;
+            }
+        }
+    }
+    assert(0 == process_wait(&p));
+    process_close(&p);
+    assert(in_len == out_len);
+    assert(0 == memcmp(in, out, in_len));
+
+    for (size_t i = 0; i < in_len; i++) {
+        in[i] = 'a' + i % 26;
+    }
+    p = process_async((char*[]){"wc", "-c", NULL});
+    process_write_stdin(&p, in);
+    assert(0 == process_wait(&p));
+    char *count = process_read_stdout(&p);
+    assert(in_len == strtoul(count, NULL, 10));
+    free(count);
+    process_close(&p);
+
+    p = process_async((char*[]){"true", NULL});
+    process_wait(&p);
+    assert(-1 == process_write_stdin_n(&p, "x", 1));
+    process_close(&p);
+
+    free(in);
+    free(out);
+}
+
+void test_process_wait_any() {
+    Process processes[4];
+    for (int i = 0; i < 3; i++) {
+        char code[8];
+        snprintf(code, sizeof(code), "exit %d", i + 1);
+        processes[i] = process_async((char*[]){"sh", "-c", code, NULL});
+    }
+    processes[3] = process_async((char*[]){"sleep", "5", NULL});
+
+    int exited[3] = {0};
+    for (int i = 0; i < 3; i++) {
+        int status;
+        long index = process_wait_any(processes, 4, -1, &status);
+        assert(index >= 0 && index < 3);
+        assert(index + 1 == status);
+        assert(-1 == processes[index].pid);
+        exited[index] = 1;
+    }
+    assert(exited[0] && exited[1] && exited[2]);
+
+    assert(-1 == process_wait_any(processes, 4, 50, NULL));
+    assert(ETIMEDOUT == errno);
+
+    int pid_fd = process_pidfd(&processes[3]);
+    kill(processes[3].pid, SIGKILL);
+    if (pid_fd >= 0) {
+        struct pollfd fd = {.fd = pid_fd, .events = POLLIN};
+        assert(1 == poll(&fd, 1, 5000));
+    }
+    int status;
+    assert(3 == process_wait_any(processes, 4, 5000, &status));
+    assert(SIGKILL == status);
+    assert(-1 == process_wait_any(processes, 4, 0, NULL));
+    assert(ECHILD == errno);
+
+    for (int i = 0; i < 4; i++) {
+        process_close(&processes[i]);
+    }
+
+    sigset_t mask;
+    sigprocmask(SIG_BLOCK, NULL, &mask);
+    assert(!sigismember(&mask, SIGCHLD));
+
+    int stdin_open = -1 != fcntl(0, F_GETFD);
+    Process empty = {0};
+    empty.stdin_fd = empty.stdout_fd = empty.stderr_fd = -1;
+    process_close(&empty);
+    assert(stdin_open == (-1 != fcntl(0, F_GETFD)));
+}
+
+void test_process_usage() {
+    ProcessUsage usage;
+    Process p = process_async((char*[]){"sh", "-c", "sleep 0.1; head -c 10000000 /dev/zero | wc -c", NULL});
+    assert(0 == process_wait_timeout(&p, -1, &usage));
+    assert(usage.wall_time >= 0.1);
+    assert(usage.user_time + usage.system_time > 0);
+    assert(usage.max_rss > 0);
+    assert(!usage.timed_out);
+    process_close(&p);
+
+    p = process_async((char*[]){"sleep", "5", NULL});
+    assert(SIGTERM == process_wait_timeout(&p, 100, &usage));
+    assert(usage.timed_out);
+    assert(usage.wall_time >= 0.1);
+    assert(usage.wall_time < 2);
+    process_close(&p);
+
+    p = process_async_with(.cmd = (char*[]){"sh", "-c", "ulimit -v; ulimit -t", NULL}, .limits = (ProcessLimit[]){{RLIMIT_AS, 256 << 20}, {RLIMIT_CPU, 10}}, .limits_len = 2);
+    assert(0 == process_wait_timeout(&p, 5000, NULL));
+    char *out = process_read_stdout(&p);
+    assert(0 == strcmp("262144\n10\n", out));
+    free(out);
+    process_close(&p);
+}
+
+void test_process_worker() {
+    // cat answers each frame with the same frame, so it works as an echo worker.
+    // The command is used again when a worker restarts, so it needs to outlive the calls.
+    char *cat[] = {"cat", NULL};
+    ProcessWorker w = {0};
+    assert(0 == process_worker_start(&w, cat));
+    char *response;
+    size_t response_len;
+    for (int i = 0; i < 100; i++) {
+        char request[16];
+        int len = snprintf(request, sizeof(request), "request %d", i);
+        assert(0 == process_worker_call(&w, request, len, &response, &response_len));
+        assert((size_t) len == response_len);
+        assert(0 == strcmp(request, response));
+    }
+    size_t large_len = 1024 * 1024;
+    char *large = malloc(large_len);
+    memset(large, 'x', large_len);
+    large[1] = '\0';
+    assert(0 == process_worker_call(&w, large, large_len, &response, &response_len));
+    assert(large_len == response_len);
+    assert(0 == memcmp(large, response, large_len));
+    free(large);
+
+    // A worker that died is restarted and the request is sent to the new one.
+    kill(w.process.pid, SIGKILL);
+    process_wait(&w.process);
+    assert(-1 == w.process.pid);
+    assert(0 == process_worker_call(&w, "again", 5, &response, NULL));
+    assert(0 == strcmp("again", response));
+    assert(1 == w.restarts);
+    process_worker_stop(&w);
+
+    // A stopped worker is not restarted by a call.
+    assert(-1 == process_worker_call(&w, "stopped", 7, &response, NULL));
+    assert(EINVAL == errno);
+    assert(1 == w.restarts);
+
+    // The worker echoes the first frame and reads the second one without answering.
+    char *once[] = {"sh", "-c", "head -c 9; head -c 10 > /dev/null", NULL};
+    w = (ProcessWorker) {0};
+    assert(0 == process_worker_start(&w, once));
+    assert(0 == process_worker_call(&w, "first", 5, &response, NULL));
+    assert(0 == strcmp("first", response));
+    assert(-1 == process_worker_call(&w, "second", 6, &response, NULL));
+    assert(1 == w.restarts);
+    assert(0 == process_worker_call(&w, "third", 5, &response, NULL));
+    assert(0 == strcmp("third", response));
+    process_worker_stop(&w);
+
+    // A worker whose restart failed is restarted again by the next call.
+    char *flaky[] = {"cat", NULL};
+    w = (ProcessWorker) {0};
+    assert(0 == process_worker_start(&w, flaky));
+    kill(w.process.pid, SIGKILL);
+    process_wait(&w.process);
+    flaky[0] = "/nonexistent/worker";
+    assert(-1 == process_worker_call(&w, "lost", 4, &response, NULL));
+    flaky[0] = "cat";
+    assert(0 == process_worker_call(&w, "fourth", 6, &response, NULL));
+    assert(0 == strcmp("fourth", response));
+    process_worker_stop(&w);
+
+    ProcessWorkerPool pool;
+    assert(-1 == process_worker_pool_start(&pool, cat, 0));
+    assert(EINVAL == errno);
+    assert(NULL == process_worker_pool_next(&pool));
+    assert(-1 == process_worker_pool_call(&pool, "none", 4, &response, NULL));
+    assert(EINVAL == errno);
+    assert(0 == process_worker_pool_start(&pool, cat, 3));
+    for (int i = 0; i < 3; i++) {
+        assert(0 == process_worker_send(process_worker_pool_next(&pool), "abc" + i, 3 - i));
+    }
+    for (int i = 0; i < 3; i++) {
+        assert(0 == process_worker_receive(&pool.workers[i], &response, &response_len));
+        assert(0 == strcmp("abc" + i, response));
+    }
+    for (int i = 0; i < 6; i++) {
+        assert(0 == process_worker_pool_call(&pool, "pool", 4, &response, NULL));
+        assert(0 == strcmp("pool", response));
+    }
+    assert(0 == pool.next);
+    process_worker_pool_stop(&pool);
+}
+
 void test_vector() {
     int *v = NULL;
     assert(0 == vector_length(v));
@@ -162,7 +627,309 @@ void test_vector() {
     vector_free(list);
 }
 
-BFUTILS_VECTOR_FREE_WRAPPER(free_matrix_element, int*, vector_free)
+void test_vector_capacity() {
+    int *v = NULL;
+    vector_reserve_exact(v, 10);
+    assert(10 == vector_capacity(v));
+    assert(0 == vector_length(v));
+    for (int i = 0; i < 200; i++) {
+        vector_push(v, i);
+    }
+    assert(200 < vector_capacity(v));
+    vector_shrink_to_fit(v);
+    assert(200 == vector_capacity(v));
+    assert(199 == v[199]);
+
+    vector_truncate(v, 50);
+    assert(50 == vector_length(v));
+    assert(200 == vector_capacity(v));
+    vector_truncate(v, 100);
+    assert(50 == vector_length(v));
+
+    vector_clear(v);
+    assert(0 == vector_length(v));
+    assert(200 == vector_capacity(v));
+
+    vector_push(v, 42);
+    int *other = vector_detach(v);
+    assert(v == NULL);
+    assert(1 == vector_length(other));
+    assert(42 == other[0]);
+    vector_free(other);
+
+    int **matrix = vector(free_matrix_element);
+    for (int i = 0; i < 10; i++) {
+        vector_push(matrix, NULL);
+        vector_push(matrix[i], i);
+    }
+    vector_truncate(matrix, 5);
+    assert(5 == vector_length(matrix));
+    vector_clear(matrix);
+    assert(0 == vector_length(matrix));
+    vector_free(matrix);
+}
+
+void test_vector_insert_erase() {
+    int *v = NULL;
+    for (int i = 0; i < 10; i++) {
+        vector_push(v, i);
+    }
+    vector_insert(v, 0, -1);
+    vector_insert(v, 5, 100);
+    vector_insert(v, vector_length(v), 200);
+    assert(13 == vector_length(v));
+    assert(-1 == v[0]);
+    assert(0 == v[1]);
+    assert(100 == v[5]);
+    assert(4 == v[6]);
+    assert(200 == v[12]);
+
+    vector_erase_range(v, 5, 6);
+    vector_erase_range(v, 0, 1);
+    vector_erase_range(v, 10, 11);
+    assert(10 == vector_length(v));
+    for (int i = 0; i < 10; i++) {
+        assert(i == v[i]);
+    }
+
+    // Inverted bounds remove nothing, and out-of-range bounds are clamped to the length.
+    vector_erase_range(v, 5, 2);
+    vector_erase_range(v, 20, 30);
+    assert(10 == vector_length(v));
+    vector_push(v, 10);
+    vector_erase_range(v, 10, 50);
+    assert(10 == vector_length(v));
+    assert(9 == v[9]);
+
+    int values[] = {20, 21, 22};
+    vector_insert_n(v, 2, values, 3);
+    assert(13 == vector_length(v));
+    assert(1 == v[1]);
+    assert(22 == v[4]);
+    assert(2 == v[5]);
+
+    vector_splice(v, 2, 3, (int[]){30}, 1);
+    assert(11 == vector_length(v));
+    assert(30 == v[2]);
+    assert(2 == v[3]);
+
+    vector_splice(v, 0, 1, values, 3);
+    assert(13 == vector_length(v));
+    assert(20 == v[0]);
+    assert(1 == v[3]);
+
+    assert(21 == vector_swap_remove(v, 1));
+    assert(12 == vector_length(v));
+    assert(9 == v[1]);
+    assert(8 == vector_swap_remove(v, 11));
+    assert(11 == vector_length(v));
+    assert(0 == vector_swap_remove(v, 11));
+    assert(11 == vector_length(v));
+
+    int *empty = NULL;
+    assert(0 == vector_swap_remove(empty, 0));
+    assert(0 == vector_length(empty));
+
+    int *big = NULL;
+    int many[300] = {0};
+    vector_insert_n(big, 0, many, 300);
+    assert(300 == vector_length(big));
+    assert(300 <= vector_capacity(big));
+    vector_free(big);
+    vector_free(v);
+}
+
+typedef struct {
+    int id;
+    double weight;
+} Feature;
+
+void test_vector_serialization() {
+    Feature *v = NULL;
+    for (int i = 0; i < 1000; i++) {
+        vector_push(v, ((Feature) {.id = i, .weight = i * 0.5}));
+    }
+    char path[] = "/tmp/bfutils_vector_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(0 == vector_write(fd, v));
+    lseek(fd, 0, SEEK_SET);
+
+    Feature *r = NULL;
+    vector_read(fd, r);
+    assert(r != NULL);
+    assert(1000 == vector_length(r));
+    assert(999 == r[999].id);
+    assert(499.5 == r[999].weight);
+
+    lseek(fd, 0, SEEK_SET);
+    int *wrong = NULL;
+    vector_read(fd, wrong);
+    assert(wrong == NULL);
+    close(fd);
+
+    Feature *m = NULL;
+    vector_mmap(path, m);
+    assert(m != NULL);
+    assert(1000 == vector_length(m));
+    assert(0 == memcmp(v, m, sizeof(Feature) * 1000));
+    vector_munmap(m);
+    assert(m == NULL);
+
+    // Bytes after the elements are not part of the vector.
+    fd = open(path, O_WRONLY | O_APPEND);
+    assert(8 == write(fd, "trailing", 8));
+    close(fd);
+    vector_mmap(path, m);
+    assert(m != NULL);
+    assert(1000 == vector_length(m));
+    assert(999 == m[999].id);
+    vector_munmap(m);
+
+    // A corrupt length must not be trusted, and a truncated file must be rejected.
+    fd = open(path, O_RDWR);
+    assert(fd >= 0);
+    size_t huge = SIZE_MAX / 2;
+    assert(sizeof(huge) == pwrite(fd, &huge, sizeof(huge), offsetof(BFUtilsVectorFileHeader, header.length)));
+    Feature *corrupt = NULL;
+    vector_read(fd, corrupt);
+    assert(corrupt == NULL);
+    vector_mmap(path, corrupt);
+    assert(corrupt == NULL);
+    size_t length = 1000;
+    assert(sizeof(length) == pwrite(fd, &length, sizeof(length), offsetof(BFUtilsVectorFileHeader, header.length)));
+    assert(0 == ftruncate(fd, BFUTILS_VECTOR_FILE_HEADER_SIZE + sizeof(Feature) * 999));
+    lseek(fd, 0, SEEK_SET);
+    vector_read(fd, corrupt);
+    assert(corrupt == NULL);
+    vector_mmap(path, corrupt);
+    assert(corrupt == NULL);
+    close(fd);
+
+    unlink(path);
+    vector_free(r);
+    vector_free(v);
+}
+
+void test_string_format() {
+    char *s = string_format("%s-%d", "abc", 10);
+    assert(0 == strcmp("abc-10", s));
+    assert(6 == vector_length(s));
+    size_t capacity = vector_capacity(s);
+    string_push_format(s, " %d", 20);
+    assert(0 == strcmp("abc-10 20", s));
+    assert(capacity == vector_capacity(s));
+
+    char large[1000];
+    memset(large, 'x', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+    string_push_format(s, "[%s]", large);
+    assert(9 + 1001 == vector_length(s));
+    assert(']' == s[vector_length(s) - 1]);
+    assert('\0' == s[vector_length(s)]);
+    vector_free(s);
+
+    char *n = NULL;
+    string_push_int(n, 0);
+    string_push_cstr(n, " ");
+    string_push_int(n, -1234567);
+    string_push_cstr(n, " ");
+    string_push_int(n, -9223372036854775807LL - 1);
+    string_push_cstr(n, " ");
+    string_push_uint(n, 18446744073709551615ULL);
+    assert(0 == strcmp("0 -1234567 -9223372036854775808 18446744073709551615", n));
+    vector_free(n);
+
+    double values[] = {0, 1.5, -2.25, 3.14159, 1e17, 1e20, -0.001, 123456.789};
+    int precisions[] = {0, 1, 2, 3, 6, 9};
+    for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++) {
+        for (size_t j = 0; j < sizeof(precisions) / sizeof(*precisions); j++) {
+            char *d = NULL;
+            string_push_double(d, values[i], precisions[j]);
+            char expected[64];
+            snprintf(expected, sizeof(expected), "%.*f", precisions[j], values[i]);
+            assert(0 == strcmp(expected, d));
+            vector_free(d);
+        }
+    }
+}
+
+void test_string_utf8() {
+    const char *text = "Olá, mundo! \xe2\x82\xac \xf0\x9f\x98\x80 plus some ascii to cross a 32 byte block";
+    size_t n = strlen(text);
+    assert(string_utf8_valid(text, n));
+    assert(n - 1 - 2 - 3 == string_utf8_length(text, n));
+    assert(!string_utf8_valid("\xc0\xaf", 2));
+    assert(!string_utf8_valid("\xed\xa0\x80", 3));
+    assert(!string_utf8_valid("\xf4\x90\x80\x80", 4));
+    assert(!string_utf8_valid("abc\xe2\x82", 5));
+    assert(NULL == string_utf8_to_utf32("\xff", 1));
+
+    uint32_t *utf32 = string_utf8_to_utf32(text, n);
+    assert(string_utf8_length(text, n) == vector_length(utf32));
+    assert(0xE1 == utf32[2]);
+    assert(0x20AC == utf32[12]);
+    assert(0x1F600 == utf32[14]);
+    char *back = string_utf32_to_utf8(utf32, vector_length(utf32));
+    assert(n == vector_length(back));
+    assert(0 == strcmp(text, back));
+
+    uint16_t *utf16 = string_utf8_to_utf16(text, n);
+    assert(vector_length(utf32) + 1 == vector_length(utf16));
+    assert(0xD83D == utf16[14]);
+    assert(0xDE00 == utf16[15]);
+    char *back16 = string_utf16_to_utf8(utf16, vector_length(utf16));
+    assert(0 == strcmp(text, back16));
+    assert(NULL == string_utf16_to_utf8((uint16_t[]){0xDC00}, 1));
+
+    char *lower = NULL;
+    string_push_cstr(lower, "HeLLo WORLD, Olá [@] this Has MORE than 32 Bytes");
+    string_ascii_lower(lower, vector_length(lower));
+    assert(0 == strcmp("hello world, olá [@] this has more than 32 bytes", lower));
+    string_ascii_upper(lower, vector_length(lower));
+    assert(0 == strcmp("HELLO WORLD, OLá [@] THIS HAS MORE THAN 32 BYTES", lower));
+
+    vector_free(lower);
+    vector_free(back16);
+    vector_free(utf16);
+    vector_free(back);
+    vector_free(utf32);
+}
+
+void test_string_builder() {
+    StringBuilder sb = string_builder(16);
+    string_builder_append_cstr(&sb, "Hello");
+    string_builder_append(&sb, ", world", 7);
+    string_builder_appendf(&sb, " %d %s", 42, "and a long formatted tail");
+    assert(41 == string_builder_length(&sb));
+    assert(3 == vector_length(sb.chunks));
+
+    char *str = string_builder_to_string(&sb);
+    assert(0 == strcmp("Hello, world 42 and a long formatted tail", str));
+
+    char path[] = "/tmp/bfutils_builder_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(0 == string_builder_flush(&sb, fd));
+    assert(0 == string_builder_length(&sb));
+    assert(1 == vector_length(sb.chunks));
+
+    char buffer[64] = {0};
+    lseek(fd, 0, SEEK_SET);
+    assert(41 == read(fd, buffer, sizeof(buffer)));
+    assert(0 == strcmp(str, buffer));
+    close(fd);
+    unlink(path);
+
+    string_builder_appendf(&sb, "%s", "reused");
+    char *reused = string_builder_to_string(&sb);
+    assert(0 == strcmp("reused", reused));
+
+    vector_free(reused);
+    vector_free(str);
+    string_builder_free(&sb);
+}
+
 void test_element_free() {
     int **matrix = vector(free_matrix_element);
     for (int i = 0; i < 10; i++) {
@@ -201,6 +968,201 @@ void test_hash_element_free() {
     hashmap_free(map);
 }
 
+void test_deque() {
+    int *d = NULL;
+    assert(0 == deque_length(d));
+    for (int i = 0; i < 100; i++) {
+        deque_push_back(d, i);
+    }
+    for (int i = 1; i <= 100; i++) {
+        deque_push_front(d, -i);
+    }
+    assert(200 == deque_length(d));
+    assert(256 == deque_capacity(d));
+    assert(-100 == deque_front(d));
+    assert(99 == deque_back(d));
+    assert(0 == deque_at(d, 100));
+
+    assert(-100 == deque_pop_front(d));
+    assert(99 == deque_pop_back(d));
+    assert(198 == deque_length(d));
+    for (int i = -99; i < 99; i++) {
+        assert(i == deque_pop_front(d));
+    }
+    assert(0 == deque_length(d));
+
+    for (int i = 0; i < 1000; i++) {
+        deque_push_back(d, i);
+        if (i % 3 == 0) {
+            assert(i / 3 == deque_pop_front(d));
+        }
+    }
+    assert(666 == deque_length(d));
+
+    struct iovec iov[2];
+    int segments = deque_iovec(d, iov);
+    size_t bytes = 0;
+    for (int i = 0; i < segments; i++) {
+        bytes += iov[i].iov_len;
+    }
+    assert(666 * sizeof(int) == bytes);
+    assert(334 == ((int*) iov[0].iov_base)[0]);
+
+    deque_drop_front(d, 600);
+    assert(66 == deque_length(d));
+    assert(934 == deque_front(d));
+    deque_clear(d);
+    assert(0 == deque_length(d));
+    deque_free(d);
+    assert(d == NULL);
+}
+
+static void *spsc_producer(void *arg) {
+    long *q = (long*) arg;
+    for (long i = 0; i < 100000; i++) {
+        while (!spsc_push(q, i)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void test_spsc() {
+    long *q = spsc_queue(long, 100);
+    assert(128 == spsc_capacity(q));
+    long value;
+    assert(!spsc_pop(q, &value));
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, spsc_producer, q);
+    int ordered = 1;
+    for (long i = 0; i < 100000; i++) {
+        while (!spsc_pop(q, &value)) {
+            sched_yield();
+        }
+        ordered = ordered && value == i;
+    }
+    pthread_join(producer, NULL);
+    assert(ordered);
+    assert(0 == spsc_length(q));
+    spsc_free(q);
+}
+
+void test_bitset() {
+    uint64_t *a = NULL;
+    uint64_t *b = NULL;
+    bitset_resize(a, 1000);
+    bitset_resize(b, 1000);
+    assert(1000 == bitset_length(a));
+    assert(16 == bitset_words(a));
+    assert(0 == bitset_count(a));
+    assert(-1 == bitset_next_set(a, 0));
+
+    for (size_t i = 0; i < 1000; i += 3) {
+        bitset_set(a, i);
+    }
+    for (size_t i = 0; i < 1000; i += 5) {
+        bitset_set(b, i);
+    }
+    assert(bitset_test(a, 999));
+    assert(!bitset_test(a, 998));
+    assert(334 == bitset_count(a));
+    assert(34 == bitset_rank(a, 100));
+    assert(3 == bitset_next_set(a, 1));
+    assert(999 == bitset_next_set(a, 997));
+    assert(1 == bitset_next_clear(a, 0));
+
+    bitset_clear(a, 3);
+    assert(6 == bitset_next_set(a, 1));
+    bitset_set(a, 3);
+
+    uint64_t *c = NULL;
+    bitset_resize(c, 1000);
+    bitset_or(c, a);
+    bitset_and(c, b);
+    assert(67 == bitset_count(c));
+    assert(15 == bitset_next_set(c, 1));
+
+    bitset_clear_all(c);
+    bitset_or(c, a);
+    bitset_andnot(c, b);
+    assert(334 - 67 == bitset_count(c));
+
+    bitset_xor(c, c);
+    assert(0 == bitset_count(c));
+
+    bitset_resize(a, 10);
+    assert(4 == bitset_count(a));
+    bitset_resize(a, 2000);
+    assert(4 == bitset_count(a));
+    assert(-1 == bitset_next_set(a, 10));
+    bitset_set(a, 1999);
+    assert(1999 == bitset_next_set(a, 10));
+
+    bitset_free(a);
+    bitset_free(b);
+    bitset_free(c);
+    assert(a == NULL);
+}
+
+// Generates the build.ninja from build_c on a temporary directory and returns its content.
+// ninja is not on PATH, so nothing is compiled.
+char *generate_build_ninja(char *build_c) {
+    char *script = "dir=$(mktemp -d) && cp bfutils_build.h \"$dir\" && cd \"$dir\" && printf '%s' \"$1\" > build.c"
+        " && ${CC:-cc} -DSTAGE2 -o build build.c && PATH=/nonexistent ./build > /dev/null 2>&1;"
+        " cat target/build.ninja target/*/build.ninja 2> /dev/null; cd / && rm -rf \"$dir\"";
+    char *out = NULL;
+    process_sync((char*[]){"sh", "-c", script, "sh", build_c, NULL}, NULL, &out, NULL);
+    return out;
+}
+
+void test_build_objects() {
+    char *build_c =
+        "#define BFUTILS_BUILD_IMPLEMENTATION\n"
+        "#include \"bfutils_build.h\"\n"
+        "void bfutils_build(int argc, char *argv[]) {\n"
+        "    (void) argc; (void) argv;\n"
+        "    bfutils_add_executable(.name = \"app\", .files = (char*[]){\"main.c\", \"a/util.c\", \"./a/util.S\", \"a//util.c\"}, .files_len = 4);\n"
+        "}\n";
+    char *ninja = generate_build_ninja(build_c);
+    assert(ninja != NULL);
+    assert(NULL != strstr(ninja, "build target/objs/a/util.o: cc a/util.c\n"));
+    assert(NULL != strstr(ninja, "build target/objs/.targets/app/a/util.S.o: cc a/util.S\n"));
+    assert(NULL != strstr(ninja, "build target/bin/app: link target/objs/main.o target/objs/a/util.o target/objs/.targets/app/a/util.S.o\n"));
+    free(ninja);
+}
+
+void test_build_unity() {
+    char *build_c =
+        "#define BFUTILS_BUILD_PROFILES X(\"release\", \"-O2\", \"\")\n"
+        "#define BFUTILS_BUILD_IMPLEMENTATION\n"
+        "#include \"bfutils_build.h\"\n"
+        "void bfutils_build(int argc, char *argv[]) {\n"
+        "    (void) argc; (void) argv;\n"
+        "    bfutils_add_executable(.name = \"app.x\", .unity = 2, .files = (char*[]){\"a.c\", \"b.c\"}, .files_len = 2);\n"
+        "}\n";
+    char *ninja = generate_build_ninja(build_c);
+    assert(ninja != NULL);
+    // Each profile has its own unity files.
+    assert(NULL == strstr(ninja, "target/unity/"));
+    assert(NULL != strstr(ninja, ": cc target/release/unity/app_x/0.c\n"));
+    free(ninja);
+
+    // Names that are the same once sanitized are rejected.
+    build_c =
+        "#define BFUTILS_BUILD_IMPLEMENTATION\n"
+        "#include \"bfutils_build.h\"\n"
+        "void bfutils_build(int argc, char *argv[]) {\n"
+        "    (void) argc; (void) argv;\n"
+        "    bfutils_add_executable(.name = \"app.x\", .files = (char*[]){\"a.c\"}, .files_len = 1);\n"
+        "    bfutils_add_executable(.name = \"app_x\", .files = (char*[]){\"b.c\"}, .files_len = 1);\n"
+        "}\n";
+    ninja = generate_build_ninja(build_c);
+    assert(ninja != NULL);
+    assert(NULL == strstr(ninja, "build "));
+    free(ninja);
+}
+
 static int test_count;
 static int success_count;
 
@@ -239,9 +1201,29 @@ void after_all() {
 #define BFUTILS_TEST_LIST \
     X("bfutils_vector", test_vector) \
     X("bfutils_vector element free", test_element_free)\
+    X("bfutils_vector capacity", test_vector_capacity)\
+    X("bfutils_vector insert and erase", test_vector_insert_erase)\
+    X("bfutils_vector serialization", test_vector_serialization)\
+    X("bfutils_vector string format", test_string_format)\
+    X("bfutils_vector utf8", test_string_utf8)\
+    X("bfutils_vector string builder", test_string_builder)\
+    X("bfutils_deque", test_deque) \
+    X("bfutils_deque spsc", test_spsc) \
+    X("bfutils_bitset", test_bitset) \
     X("bfutils_hash", test_hash) \
     X("bfutils_hash element free", test_hash_element_free)\
-    X("bfutils_process", test_process)
+    X("bfutils_process", test_process)\
+    X("bfutils_process communicate", test_process_communicate)\
+    X("bfutils_process binary output", test_process_binary_output)\
+    X("bfutils_process pool", test_process_pool)\
+    X("bfutils_process pipeline", test_process_pipeline)\
+    X("bfutils_process redirect", test_process_redirect)\
+    X("bfutils_process stdin stream", test_process_stdin_stream)\
+    X("bfutils_process wait any", test_process_wait_any)\
+    X("bfutils_process usage", test_process_usage)\
+    X("bfutils_process worker", test_process_worker)\
+    X("bfutils_build objects", test_build_objects)\
+    X("bfutils_build unity", test_build_unity)
 
 
 #define BFUTILS_TEST_MAIN